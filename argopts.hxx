@@ -25,201 +25,2618 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm> // for fill
+#include <iterator>
 #include <list>
+#include <vector>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <sstream>
 #include <initializer_list>
-#include <typeinfo>
-#include <functional>
 #include <stdexcept>
 #include <memory> // For unique_ptr
 #include <cctype> // for isdigit
+#include <cerrno>
+#include <cmath> // for abs
+#include <cstdio> // for snprintf
+#include <clocale> // for localeconv
+#include <cstdlib> // for strtol, strtod etc.
+#include <limits>
+#include <type_traits>
+#include <cstring> // for strlen, memchr, memcmp
+#include <chrono>
+#include <fstream>
 
 #include <iostream>
 
-#ifdef __GNUG__ // gnu C++ compiler
-  #include <cxxabi.h>
+// Files given as "@file" values are mapped into memory where possible.
+// Define ARGOPTS_NO_MMAP to always read them instead.
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(ARGOPTS_NO_MMAP)
+  #define ARGOPTS_HAVE_MMAP 1
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+// Errors are reported with exceptions where they are available. If the
+// code is compiled without exceptions (e.g. -fno-exceptions) then the
+// message is printed to stderr and the program aborts instead; the
+// tryGet() methods report errors without either.
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+  #define ARGOPTS_THROW(exception) throw exception
+#else
+  #define ARGOPTS_THROW(exception) ::ArgOpts::detail::abortWith(exception)
 #endif
 
 namespace ArgOpts {
-#ifdef __GNUG__ // gnu C++ compiler
+  namespace detail {
+    /// Used in place of throw when exceptions are disabled
+    [[noreturn]] inline void abortWith(const std::exception &error) {
+      std::fprintf(stderr, "%s\n", error.what());
+      std::abort();
+    }
+
+    /// FNV-1a hash of a null-terminated string, usable at compile time
+    constexpr std::uint32_t hashName(const char *name, std::uint32_t hash = 2166136261u) {
+      return (*name == 0) ? hash
+        : hashName(name + 1, (hash ^ static_cast<unsigned char>(*name)) * 16777619u);
+    }
+
+    /// FNV-1a hash of a string of the given length.
+    /// Gives the same result as hashName for strings without a null
+    inline std::uint32_t hashBytes(const char *data, std::size_t length,
+                                   std::uint32_t hash = 2166136261u) {
+      for (std::size_t n = 0; n < length; n++) {
+        hash = (hash ^ static_cast<unsigned char>(data[n])) * 16777619u;
+      }
+      return hash;
+    }
+
+    /// Mixes a hash so that every bit depends on every other, using
+    /// the finaliser of MurmurHash3. The low bits of an FNV-1a hash
+    /// depend only on the low bits of its input and starting value
+    inline std::uint32_t mixHash(std::uint32_t hash) {
+      hash ^= hash >> 16;
+      hash *= 0x85ebca6bu;
+      hash ^= hash >> 13;
+      hash *= 0xc2b2ae35u;
+      hash ^= hash >> 16;
+      return hash;
+    }
+
+    /// Hash of a string with a seed, used by the perfect hash
+    /// tables which argopts_gen generates
+    inline std::uint32_t seededHash(const char *data, std::size_t length, std::uint32_t seed) {
+      return mixHash(hashBytes(data, length, 2166136261u ^ seed));
+    }
+
+    /// The slot of a string in a perfect hash table generated by argopts_gen.
+    /// The first hash selects one of bucket_count seeds, and the hash
+    /// with that seed selects one of slot_count slots
+    inline std::size_t perfectHashSlot(const char *data, std::size_t length,
+                                       const std::uint32_t *seeds, std::uint32_t bucket_count,
+                                       std::uint32_t slot_count) {
+      const std::uint32_t seed = seeds[seededHash(data, length, 0) % bucket_count];
+      return seededHash(data, length, seed) % slot_count;
+    }
+
+    /// Holds StringRef::npos. Static members of a class template
+    /// can be defined in a header, so npos can be used by reference
+    template <typename T = void> struct StringRefConstants {
+      static const std::size_t npos;
+    };
+
+    template <typename T>
+    const std::size_t StringRefConstants<T>::npos = static_cast<std::size_t>(-1);
+  } // namespace detail
+
+  /// A non-owning reference to a string of characters,
+  /// similar to C++17 std::string_view
+  ///
+  /// This does not copy the characters, so the string
+  /// referred to must outlive the StringRef
+  class StringRef : public detail::StringRefConstants<> {
+  public:
+    constexpr StringRef() : ptr(""), len(0) {}
+    constexpr StringRef(const char *data, std::size_t length) : ptr(data), len(length) {}
+    StringRef(const char *str) : ptr(str), len(std::strlen(str)) {}
+    StringRef(const std::string &str) : ptr(str.data()), len(str.length()) {}
+
+    const char *data() const { return ptr; }
+    std::size_t size() const { return len; }
+    std::size_t length() const { return len; }
+    bool empty() const { return len == 0; }
+
+    const char *begin() const { return ptr; }
+    const char *end() const { return ptr + len; }
+    char operator[](std::size_t pos) const { return ptr[pos]; }
+
+    /// Position of the first occurrence of c, or npos
+    std::size_t find(char c, std::size_t pos = 0) const {
+      if (pos >= len) {
+        return npos;
+      }
+      const void *found = std::memchr(ptr + pos, c, len - pos);
+      if (found == nullptr) {
+        return npos;
+      }
+      return static_cast<const char*>(found) - ptr;
+    }
+
+    /// A reference to part of this string
+    StringRef substr(std::size_t pos, std::size_t count = npos) const {
+      if (pos > len) {
+        pos = len;
+      }
+      return {ptr + pos, std::min(count, len - pos)};
+    }
+
+    /// Copy into a std::string. This is the only operation which allocates
+    std::string str() const { return std::string(ptr, len); }
+    operator std::string() const { return str(); }
+
+    friend bool operator==(StringRef a, StringRef b) {
+      return (a.len == b.len) && (std::memcmp(a.ptr, b.ptr, a.len) == 0);
+    }
+    friend bool operator!=(StringRef a, StringRef b) { return !(a == b); }
+
+    friend std::ostream &operator<<(std::ostream &out, StringRef str) {
+      return out.write(str.ptr, str.len);
+    }
+
+  private:
+    const char *ptr; ///< Start of the string, not necessarily null terminated
+    std::size_t len; ///< Number of characters
+  };
+
+  /// Hash function, so StringRef can be used as a key in unordered containers
+  struct StringRefHash {
+    std::size_t operator()(StringRef str) const {
+      return detail::hashBytes(str.data(), str.size());
+    }
+  };
+
+  /// The result of converting a value
+  enum class ConversionStatus {
+    ok,           ///< Converted successfully
+    missing,      ///< There was no value
+    invalid,      ///< The value was not of the expected type
+    out_of_range, ///< The value was a number outside the range of the type
+    unreadable    ///< The value named a file which could not be read
+  };
+
+  /// A short description of a conversion status
+  inline const char *describe(ConversionStatus status) {
+    switch (status) {
+    case ConversionStatus::ok: return "ok";
+    case ConversionStatus::missing: return "missing value";
+    case ConversionStatus::invalid: return "invalid value";
+    case ConversionStatus::out_of_range: return "value out of range";
+    case ConversionStatus::unreadable: return "could not read file";
+    }
+    return "unknown status";
+  }
+
+  namespace detail {
+    /// A value in quotes for an error message. Long values, such as the
+    /// contents of a file, are cut short and their length given instead
+    inline std::string quoteValue(StringRef value) {
+      const std::size_t limit = 64;
+      if (value.length() <= limit) {
+        return "'" + value.str() + "'";
+      }
+      return "'" + value.substr(0, limit - 4).str() + "...' (" +
+        std::to_string(value.length()) + " characters)";
+    }
+
+    /// Types converted by convertNumber rather than a stream.
+    /// bool and character types keep the stream behaviour
+    template <typename T> struct IsFastNumber {
+      static constexpr bool value = std::is_arithmetic<T>::value &&
+        !std::is_same<T, bool>::value && !std::is_same<T, char>::value &&
+        !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value &&
+        !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&
+        !std::is_same<T, char32_t>::value;
+    };
+
+    /// Checks that the end of a number is the end of the string,
+    /// apart from trailing whitespace, and that there was a number
+    inline bool endOfNumber(const char *str, const char *end) {
+      if (end == str) {
+        return false; // Nothing parsed
+      }
+      while (std::isspace(static_cast<unsigned char>(*end))) {
+        end++;
+      }
+      return *end == 0;
+    }
+
+    /// Removes whitespace from both ends
+    inline StringRef trim(StringRef value) {
+      std::size_t start = 0;
+      std::size_t end = value.size();
+      while ((start < end) && std::isspace(static_cast<unsigned char>(value[start]))) {
+        start++;
+      }
+      while ((end > start) && std::isspace(static_cast<unsigned char>(value[end - 1]))) {
+        end--;
+      }
+      return value.substr(start, end - start);
+    }
+
+    /// The value of a digit or letter in bases up to 36,
+    /// or 36 if the character is neither
+    inline unsigned digitValue(char c) {
+      const unsigned decimal = static_cast<unsigned>(static_cast<unsigned char>(c)) - '0';
+      if (decimal < 10) {
+        return decimal;
+      }
+      // Setting bit 5 makes letters lower case
+      const unsigned letter = (static_cast<unsigned>(static_cast<unsigned char>(c)) | 0x20u) - 'a';
+      return (letter < 26) ? letter + 10 : 36;
+    }
+
+    /// Reads an integer such as "42", "-0x7f", "0o17", "0b1010" or
+    /// "1_000_000", ignoring surrounding whitespace. Separators '_' must
+    /// be between digits. A leading zero doesn't mean octal, so "010" is ten.
+    ///
+    /// Returns invalid if the text is not an integer, and out_of_range
+    /// if the magnitude doesn't fit into an unsigned long long.
+    inline ConversionStatus readInteger(StringRef value, bool &negative,
+                                        unsigned long long &magnitude) {
+      value = trim(value);
+      std::size_t pos = 0;
+      negative = false;
+      if ((pos < value.size()) && ((value[pos] == '+') || (value[pos] == '-'))) {
+        negative = value[pos] == '-';
+        pos++;
+      }
+
+      unsigned base = 10;
+      if ((pos + 1 < value.size()) && (value[pos] == '0')) {
+        switch (value[pos + 1] | 0x20) {
+        case 'x': base = 16; pos += 2; break;
+        case 'o': base = 8; pos += 2; break;
+        case 'b': base = 2; pos += 2; break;
+        default: break;
+        }
+      }
+
+      // Larger values overflow when another digit is added
+      const unsigned long long limit = std::numeric_limits<unsigned long long>::max() / base;
+      const unsigned last_digit = static_cast<unsigned>(
+        std::numeric_limits<unsigned long long>::max() % base);
+      bool overflow = false;
+      bool after_digit = false; // Separators are only allowed after a digit
+      magnitude = 0;
+      for (; pos < value.size(); pos++) {
+        if ((value[pos] == '_') && after_digit) {
+          after_digit = false;
+          continue;
+        }
+        const unsigned digit = digitValue(value[pos]);
+        if (digit >= base) {
+          return ConversionStatus::invalid;
+        }
+        overflow |= (magnitude > limit) || ((magnitude == limit) && (digit > last_digit));
+        magnitude = magnitude * base + digit;
+        after_digit = true;
+      }
+      if (!after_digit) {
+        // No digits, or ends with a separator
+        return ConversionStatus::invalid;
+      }
+      return overflow ? ConversionStatus::out_of_range : ConversionStatus::ok;
+    }
+
+    /// Convert a sign and magnitude to an integer of type T,
+    /// checking that it is in range
+    template <typename T>
+    ConversionStatus toInteger(bool negative, unsigned long long magnitude, T &result) {
+      if (negative && (magnitude != 0)) {
+        if (!std::is_signed<T>::value ||
+            (magnitude - 1 > static_cast<unsigned long long>(std::numeric_limits<T>::max()))) {
+          return ConversionStatus::out_of_range;
+        }
+        // Written so that the minimum value doesn't overflow
+        result = static_cast<T>(-static_cast<T>(magnitude - 1) - 1);
+        return ConversionStatus::ok;
+      }
+      if (magnitude > static_cast<unsigned long long>(std::numeric_limits<T>::max())) {
+        return ConversionStatus::out_of_range;
+      }
+      result = static_cast<T>(magnitude);
+      return ConversionStatus::ok;
+    }
+
+    inline long double strtoFloat(const char *str, char **end, long double) {
+      return std::strtold(str, end);
+    }
+    inline double strtoFloat(const char *str, char **end, double) {
+      return std::strtod(str, end);
+    }
+    inline float strtoFloat(const char *str, char **end, float) {
+      return std::strtof(str, end);
+    }
+
+    /// Convert a null-terminated string to a floating point number,
+    /// using the C library
+    template <typename T>
+    ConversionStatus parseFloat(const char *str, T &result) {
+      char *end;
+      errno = 0;
+      T value = strtoFloat(str, &end, T());
+      if (!endOfNumber(str, end)) {
+        return ConversionStatus::invalid;
+      }
+      if ((errno == ERANGE) && (std::abs(value) > std::numeric_limits<T>::max())) {
+        // Overflow. Underflow to zero or a subnormal is allowed
+        return ConversionStatus::out_of_range;
+      }
+      result = value;
+      return ConversionStatus::ok;
+    }
+
+    template <typename T>
+    ConversionStatus convertNumber(StringRef value, T &result, std::false_type /*is_floating_point*/) {
+      bool negative;
+      unsigned long long magnitude;
+      ConversionStatus status = readInteger(value, negative, magnitude);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      return toInteger(negative, magnitude, result);
+    }
+
+    /// The decimal point of the C library's locale (LC_NUMERIC),
+    /// or nullptr if it is "."
+    inline const char *localeDecimalPoint() {
+      const char *point = std::localeconv()->decimal_point;
+      return ((point[0] == '.') && (point[1] == 0)) ? nullptr : point;
+    }
+
+    /// The C library needs a null terminator, which StringRef may not have,
+    /// so short values are copied into a buffer on the stack.
+    ///
+    /// Values always use '.' as the decimal point, whatever the locale,
+    /// so that a command line means the same thing everywhere. If the
+    /// program has set a locale with another decimal point, then the
+    /// value is rewritten in that locale's form, and the locale's own
+    /// decimal point (e.g. "1,5") is not accepted.
+    template <typename T>
+    ConversionStatus convertNumber(StringRef value, T &result, std::true_type /*is_floating_point*/) {
+      const char *point = localeDecimalPoint();
+      if (point != nullptr) {
+        std::string text;
+        text.reserve(value.size() + 4);
+        for (char ch : value) {
+          if (ch == point[0]) {
+            return ConversionStatus::invalid;
+          }
+          if (ch == '.') {
+            text += point;
+          } else {
+            text += ch;
+          }
+        }
+        return parseFloat(text.c_str(), result);
+      }
+
+      char buffer[64];
+      if (value.size() < sizeof(buffer)) {
+        std::memcpy(buffer, value.data(), value.size());
+        buffer[value.size()] = 0;
+        return parseFloat(buffer, result);
+      }
+      return parseFloat(value.str().c_str(), result);
+    }
+
+    /// Convert a string to a number, checking that all characters are used.
+    /// Integers may have a radix prefix and separators (see readInteger),
+    /// and floating point numbers are converted with the C library.
+    template <typename T>
+    ConversionStatus convertNumber(StringRef value, T &result) {
+      return convertNumber(value, result,
+                           std::integral_constant<bool, std::is_floating_point<T>::value>());
+    }
+
+    /// Convert a string to any type which can be read from a stream
+    /// with operator>>, checking that all characters are used
+    template <typename T>
+    ConversionStatus convertStream(StringRef value, T &result) {
+      std::stringstream ss(value);
+      ss >> result;
+      
+      // Check if the parse failed
+      if (ss.fail()) {
+        return ConversionStatus::invalid;
+      }
+      // Check if there are characters remaining
+      std::string remainder;
+      std::getline(ss, remainder);
+      for (const char &ch : remainder) {
+        if (!std::isspace(static_cast<unsigned char>(ch))) {
+          // Meaningful character not parsed
+          return ConversionStatus::invalid;
+        }
+      }
+      return ConversionStatus::ok;
+    }
+
+    // Conversions of values to strings, giving the same text as operator<<
+    // with the default stream settings
+
+    /// Write an integer in decimal, ending at the given position.
+    /// Returns the start of the text
+    template <typename T>
+    char *formatInteger(char *end, T value) {
+      using Unsigned = typename std::make_unsigned<T>::type;
+      const bool negative = value < 0;
+      // Unsigned negation is well defined, including for the minimum value
+      Unsigned magnitude = negative ? Unsigned(0) - static_cast<Unsigned>(value)
+                                    : static_cast<Unsigned>(value);
+      char *start = end;
+      do {
+        *--start = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+      } while (magnitude != 0);
+      if (negative) {
+        *--start = '-';
+      }
+      return start;
+    }
+
+    /// Enough characters for any integer, or a floating point value
+    /// with the default 6 significant figures
+    const std::size_t format_buffer_size = 48;
+
+    template <typename T>
+    void formatNumber(T value, std::string &result, std::false_type /*is_floating_point*/) {
+      char buffer[format_buffer_size];
+      char *end = buffer + sizeof(buffer);
+      char *start = formatInteger(end, value);
+      result.assign(start, end);
+    }
+
+    /// snprintf writes the decimal point of the C library's locale
+    /// (LC_NUMERIC), while streams use their own locale, which is "C"
+    /// by default
+    template <typename T>
+    void formatNumber(T value, std::string &result, std::true_type /*is_floating_point*/) {
+      char buffer[format_buffer_size];
+      // Streams print float and double with %g, precision 6
+      int length = (sizeof(T) > sizeof(double))
+        ? std::snprintf(buffer, sizeof(buffer), "%Lg", static_cast<long double>(value))
+        : std::snprintf(buffer, sizeof(buffer), "%g", static_cast<double>(value));
+      result.assign(buffer, static_cast<std::size_t>(length));
+
+      const char *point = localeDecimalPoint();
+      if (point != nullptr) {
+        std::size_t found = result.find(point);
+        if (found != std::string::npos) {
+          result.replace(found, std::strlen(point), 1, '.');
+        }
+      }
+    }
+
+    template <typename T>
+    void format(const T &value, std::string &result, std::true_type /*IsFastNumber*/) {
+      formatNumber(value, result,
+                   std::integral_constant<bool, std::is_floating_point<T>::value>());
+    }
+
+    template <typename T>
+    void format(const T &value, std::string &result, std::false_type /*IsFastNumber*/) {
+      std::stringstream ss;
+      ss << value;
+      result = ss.str();
+    }
+
+    template <typename T>
+    ConversionStatus convert(StringRef value, T &result, std::true_type /*IsFastNumber*/) {
+      return convertNumber(value, result);
+    }
+
+    template <typename T>
+    ConversionStatus convert(StringRef value, T &result, std::false_type /*IsFastNumber*/) {
+      return convertStream(value, result);
+    }
+
+    /// The name of T as written by the compiler in the function signature.
+    /// Points into a static string, so needs no allocation or RTTI
+    template <typename T> StringRef prettyTypeName() {
+#if defined(__GNUC__) || defined(__clang__)
+      // e.g. "... prettyTypeName() [with T = Foo]" (GCC) or "[T = Foo]" (clang)
+      const StringRef signature(__PRETTY_FUNCTION__);
+      const StringRef marker("T = ");
+      for (std::size_t i = 0; i + marker.length() <= signature.length(); i++) {
+        if (signature.substr(i, marker.length()) == marker) {
+          std::size_t start = i + marker.length();
+          std::size_t end = start;
+          while ((end < signature.length()) &&
+                 (signature[end] != ';') && (signature[end] != ']')) {
+            end++;
+          }
+          return signature.substr(start, end - start);
+        }
+      }
+#endif
+      return "value";
+    }
+  } // namespace detail
+
+  /// The name of a type, as used in error messages
+  ///
+  /// Common types have short names such as "int" and "string".
+  /// Other types use the name given by the compiler, or can be
+  /// given a friendlier name by specialising this template.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// namespace ArgOpts {
+  ///   template <> struct TypeName<Colour> {
+  ///     static StringRef get() { return "colour"; }
+  ///   };
+  /// }
+  ///
+  template <typename T> struct TypeName {
+    static StringRef get() { return detail::prettyTypeName<T>(); }
+  };
+
+#define ARGOPTS_TYPE_NAME(type, name)                         \
+  template <> struct TypeName<type> {                         \
+    static StringRef get() { return StringRef(name, sizeof(name) - 1); } \
+  };
+
+  ARGOPTS_TYPE_NAME(bool, "bool")
+  ARGOPTS_TYPE_NAME(char, "char")
+  ARGOPTS_TYPE_NAME(signed char, "signed char")
+  ARGOPTS_TYPE_NAME(unsigned char, "unsigned char")
+  ARGOPTS_TYPE_NAME(short, "short")
+  ARGOPTS_TYPE_NAME(unsigned short, "unsigned short")
+  ARGOPTS_TYPE_NAME(int, "int")
+  ARGOPTS_TYPE_NAME(unsigned int, "unsigned int")
+  ARGOPTS_TYPE_NAME(long, "long")
+  ARGOPTS_TYPE_NAME(unsigned long, "unsigned long")
+  ARGOPTS_TYPE_NAME(long long, "long long")
+  ARGOPTS_TYPE_NAME(unsigned long long, "unsigned long long")
+  ARGOPTS_TYPE_NAME(float, "float")
+  ARGOPTS_TYPE_NAME(double, "double")
+  ARGOPTS_TYPE_NAME(long double, "long double")
+  ARGOPTS_TYPE_NAME(std::string, "string")
+
+#undef ARGOPTS_TYPE_NAME
+
+  /// Either a value, or the reason there isn't one,
+  /// returned by conversions which don't throw exceptions
+  ///
+  /// Example
+  /// -------
+  ///
+  /// Expected<int> n = opt.arg.tryGet<int>();
+  /// if (n) {
+  ///   use(*n);
+  /// } else if (n.status() == ConversionStatus::out_of_range) {
+  ///   ...
+  /// }
+  ///
+  /// int threads = opt.arg.tryGet<int>().valueOr(1);
+  ///
+  template <typename T>
+  class Expected {
+  public:
+    Expected(T value) : result(std::move(value)), state(ConversionStatus::ok) {}
+    Expected(ConversionStatus status) : result(), state(status) {}
+
+    bool ok() const { return state == ConversionStatus::ok; }
+    explicit operator bool() const { return ok(); }
+    ConversionStatus status() const { return state; }
+
+    /// The value. Throws std::invalid_argument if there isn't one
+    const T &value() const {
+      if (!ok()) {
+        ARGOPTS_THROW(std::invalid_argument(describe(state)));
+      }
+      return result;
+    }
+
+    /// The value if there is one, otherwise the given alternative
+    T valueOr(T alternative) const {
+      return ok() ? result : alternative;
+    }
+
+    /// The value, which must exist
+    const T &operator*() const { return result; }
+    T &operator*() { return result; }
+    const T *operator->() const { return &result; }
+
+  private:
+    T result;
+    ConversionStatus state;
+  };
+
+  /// Converts strings to values of type T. This is the customisation
+  /// point used by StringStore::get<T>() and tryGet<T>().
+  ///
+  /// By default numbers are converted with the C library, and other types
+  /// are read from a stream with operator>>. Specialise this to convert
+  /// a type without streams, or with a different syntax.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// namespace ArgOpts {
+  ///   template <> struct Convert<Point> {
+  ///     static ConversionStatus parse(StringRef value, Point &result) {
+  ///       ...
+  ///       return ConversionStatus::ok;
+  ///     }
+  ///   };
+  /// }
+  ///
+  /// The value passed to parse is never empty; missing values are
+  /// handled by StringStore.
+  ///
+  template <typename T, typename Enable = void>
+  struct Convert {
+    static ConversionStatus parse(StringRef value, T &result) {
+      return detail::convert(value, result,
+                             std::integral_constant<bool, detail::IsFastNumber<T>::value>());
+    }
+  };
+
+  /// Convert a string to a value of type T, using Convert<T>
+  template <typename T>
+  ConversionStatus convert(StringRef value, T &result) {
+    return Convert<T>::parse(value, result);
+  }
+
+  /// Booleans are true for "1", "true", "yes" or "on", and false for
+  /// "0", "false", "no" or "off", ignoring case
+  template <>
+  struct Convert<bool> {
+    static ConversionStatus parse(StringRef value, bool &result) {
+      value = detail::trim(value);
+      char word[6] = {};
+      if (value.size() >= sizeof(word)) {
+        return ConversionStatus::invalid;
+      }
+      for (std::size_t n = 0; n < value.size(); n++) {
+        word[n] = static_cast<char>(std::tolower(static_cast<unsigned char>(value[n])));
+      }
+      const StringRef lower(word, value.size());
+      if ((lower == "1") || (lower == "true") || (lower == "yes") || (lower == "on")) {
+        result = true;
+        return ConversionStatus::ok;
+      }
+      if ((lower == "0") || (lower == "false") || (lower == "no") || (lower == "off")) {
+        result = false;
+        return ConversionStatus::ok;
+      }
+      return ConversionStatus::invalid;
+    }
+  };
+
+  /// A name for a value of an enum, as given by EnumNames
+  template <typename T>
+  struct EnumName {
+    const char *name;
+    T value;
+  };
+
+  /// Specialise this to convert an enum from its names. get() should
+  /// return the names and values; it is called once, the first time a
+  /// value of the enum is converted.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// enum class Colour { red, green };
+  ///
+  /// namespace ArgOpts {
+  ///   template <> struct EnumNames<Colour> {
+  ///     static std::vector<EnumName<Colour>> get() {
+  ///       return { {"red", Colour::red}, {"green", Colour::green} };
+  ///     }
+  ///   };
+  /// }
+  ///
+  /// Colour colour = opt.arg;  // From "--colour=green"
+  ///
+  template <typename T>
+  struct EnumNames {};
+
+  namespace detail {
+    /// True if EnumNames<T> has been specialised
+    template <typename T>
+    struct HasEnumNames {
+      template <typename U> static std::true_type test(decltype(EnumNames<U>::get()) *);
+      template <typename U> static std::false_type test(...);
+      static constexpr bool value = decltype(test<T>(nullptr))::value;
+    };
+
+    /// The names of an enum, in an open addressing hash table
+    template <typename T>
+    class EnumTable {
+    public:
+      /// The table for T, built the first time it is used
+      static const EnumTable &instance() {
+        static const EnumTable table;
+        return table;
+      }
+
+      bool find(StringRef name, T &result) const {
+        const std::uint32_t entry = slots[findSlot(name)];
+        if (entry == 0) {
+          return false;
+        }
+        result = entries[entry - 1].value;
+        return true;
+      }
+
+    private:
+      EnumTable() {
+        for (auto &entry : EnumNames<T>::get()) {
+          entries.push_back(entry);
+          names.push_back(StringRef(entry.name));
+        }
+        // At most half full, and a power of two
+        std::size_t size = 2;
+        while (size < 2 * entries.size()) {
+          size *= 2;
+        }
+        slots.assign(size, 0);
+        for (std::size_t n = 0; n < entries.size(); n++) {
+          std::size_t slot = findSlot(names[n]);
+          if (slots[slot] == 0) {
+            // If a name is repeated then the first takes precedence
+            slots[slot] = static_cast<std::uint32_t>(n + 1);
+          }
+        }
+      }
+
+      std::vector<EnumName<T>> entries;
+      std::vector<StringRef> names;     ///< The names of entries
+      std::vector<std::uint32_t> slots; ///< Index into entries plus one, or zero if empty
+
+      std::size_t findSlot(StringRef name) const {
+        const std::size_t mask = slots.size() - 1;
+        std::size_t slot = StringRefHash()(name) & mask;
+        while ((slots[slot] != 0) && (names[slots[slot] - 1] != name)) {
+          slot = (slot + 1) & mask; // Linear probing
+        }
+        return slot;
+      }
+    };
+  } // namespace detail
+
+  /// Enums with EnumNames are converted from their names
+  template <typename T>
+  struct Convert<T, typename std::enable_if<detail::HasEnumNames<T>::value>::type> {
+    static ConversionStatus parse(StringRef value, T &result) {
+      return detail::EnumTable<T>::instance().find(detail::trim(value), result) ?
+        ConversionStatus::ok : ConversionStatus::invalid;
+    }
+  };
+
+  namespace detail {
+    // Values with units, such as "512MiB" or "250ms", are read in a single
+    // pass as a decimal number followed by a suffix. The number is then
+    // multiplied by the unit's scale in integer arithmetic, checking for
+    // overflow, so no precision is lost.
+
+    /// A decimal number read by readDecimal, equal to
+    /// (whole + fraction / scale), negated if negative
+    struct Decimal {
+      unsigned long long whole = 0;
+      unsigned long long fraction = 0;
+      unsigned long long scale = 1;
+      bool negative = false;
+      bool truncated = false; ///< Non-zero digits beyond the precision were dropped
+    };
+
+    /// Reads a number such as "12", "-3.25" or ".5" from the start of value,
+    /// after any whitespace. pos is set to the first character after it
+    inline ConversionStatus readDecimal(StringRef value, std::size_t &pos, Decimal &result) {
+      const unsigned long long max = std::numeric_limits<unsigned long long>::max();
+      pos = 0;
+      while ((pos < value.size()) && std::isspace(static_cast<unsigned char>(value[pos]))) {
+        pos++;
+      }
+      if ((pos < value.size()) && ((value[pos] == '+') || (value[pos] == '-'))) {
+        result.negative = value[pos] == '-';
+        pos++;
+      }
+      bool digits = false;
+      while ((pos < value.size()) && std::isdigit(static_cast<unsigned char>(value[pos]))) {
+        const unsigned digit = static_cast<unsigned>(value[pos] - '0');
+        if (result.whole > (max - digit) / 10) {
+          return ConversionStatus::out_of_range;
+        }
+        result.whole = result.whole * 10 + digit;
+        digits = true;
+        pos++;
+      }
+      if ((pos < value.size()) && (value[pos] == '.')) {
+        pos++;
+        while ((pos < value.size()) && std::isdigit(static_cast<unsigned char>(value[pos]))) {
+          const unsigned digit = static_cast<unsigned>(value[pos] - '0');
+          if (result.scale <= max / 100) {
+            result.fraction = result.fraction * 10 + digit;
+            result.scale *= 10;
+          } else if (digit != 0) {
+            result.truncated = true;
+          }
+          digits = true;
+          pos++;
+        }
+      }
+      return digits ? ConversionStatus::ok : ConversionStatus::invalid;
+    }
+
+    inline unsigned long long gcd(unsigned long long a, unsigned long long b) {
+      while (b != 0) {
+        unsigned long long r = a % b;
+        a = b;
+        b = r;
+      }
+      return a;
+    }
+
+    /// a * b, returning false on overflow
+    inline bool multiply(unsigned long long a, unsigned long long b, unsigned long long &result) {
+      if ((a != 0) && (b > std::numeric_limits<unsigned long long>::max() / a)) {
+        return false;
+      }
+      result = a * b;
+      return true;
+    }
+
+    /// The magnitude of number * num / den, which is invalid if the
+    /// result is not a whole number
+    inline ConversionStatus scaleDecimal(const Decimal &number, unsigned long long num,
+                                         unsigned long long den, unsigned long long &result) {
+      if (number.truncated) {
+        return ConversionStatus::invalid;
+      }
+      // The fraction times num, as a reduced fraction p / q.
+      // This is only a whole number if q is one
+      const unsigned long long f = gcd(number.fraction, number.scale);
+      const unsigned long long g = gcd(num, number.scale / f);
+      if (number.scale / f / g != 1) {
+        return ConversionStatus::invalid;
+      }
+      unsigned long long whole, part;
+      if (!multiply(number.whole, num, whole) || !multiply(number.fraction / f, num / g, part) ||
+          (whole > std::numeric_limits<unsigned long long>::max() - part)) {
+        return ConversionStatus::out_of_range;
+      }
+      whole += part;
+      if (whole % den != 0) {
+        return ConversionStatus::invalid;
+      }
+      result = whole / den;
+      return ConversionStatus::ok;
+    }
+
+    /// The value of a number, for conversion to floating point types
+    inline long double toLongDouble(const Decimal &number) {
+      long double value = static_cast<long double>(number.whole) +
+        static_cast<long double>(number.fraction) / static_cast<long double>(number.scale);
+      return number.negative ? -value : value;
+    }
+
+    /// A unit suffix, equal to num / den of some base unit
+    struct Unit {
+      const char *suffix;
+      unsigned long long num;
+      unsigned long long den;
+    };
+
+    /// Find the unit with the given suffix, returning false if not known
+    template <std::size_t N>
+    bool findUnit(const Unit (&units)[N], StringRef suffix, Unit &result) {
+      for (const Unit &unit : units) {
+        if (suffix == unit.suffix) {
+          result = unit;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /// Units of time, as fractions of a second
+    inline bool findTimeUnit(StringRef suffix, Unit &result) {
+      static const Unit units[] = {
+        {"ns", 1, 1000000000}, {"us", 1, 1000000}, {"ms", 1, 1000},
+        {"s", 1, 1}, {"min", 60, 1}, {"h", 3600, 1}, {"d", 86400, 1}};
+      return findUnit(units, suffix, result);
+    }
+
+    /// Units of size, in bytes. Single letters are binary, as in GNU tools
+    inline bool findSizeUnit(StringRef suffix, Unit &result) {
+      static const Unit units[] = {
+        {"", 1, 1}, {"B", 1, 1},
+        {"k", 1024ull, 1}, {"K", 1024ull, 1}, {"KiB", 1024ull, 1}, {"kB", 1000ull, 1}, {"KB", 1000ull, 1},
+        {"M", 1ull << 20, 1}, {"MiB", 1ull << 20, 1}, {"MB", 1000000ull, 1},
+        {"G", 1ull << 30, 1}, {"GiB", 1ull << 30, 1}, {"GB", 1000000000ull, 1},
+        {"T", 1ull << 40, 1}, {"TiB", 1ull << 40, 1}, {"TB", 1000000000000ull, 1},
+        {"P", 1ull << 50, 1}, {"PiB", 1ull << 50, 1}, {"PB", 1000000000000000ull, 1},
+        {"E", 1ull << 60, 1}, {"EiB", 1ull << 60, 1}, {"EB", 1000000000000000000ull, 1}};
+      return findUnit(units, suffix, result);
+    }
+
+    /// Reads a number followed by a unit, e.g. "1.5 GiB"
+    template <typename FindUnit>
+    ConversionStatus readWithUnit(StringRef value, FindUnit findUnit,
+                                  Decimal &number, Unit &unit) {
+      std::size_t pos;
+      ConversionStatus status = readDecimal(value, pos, number);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      if (!findUnit(trim(value.substr(pos)), unit)) {
+        return ConversionStatus::invalid;
+      }
+      return ConversionStatus::ok;
+    }
+  } // namespace detail
+
+  /// A number of bytes, converted from a value such as "512MiB" or "4k"
+  ///
+  /// Suffixes are B, KiB, MiB, GiB, TiB, PiB and EiB for powers of 1024,
+  /// kB/KB, MB, GB, TB, PB and EB for powers of 1000, and K, M, G etc.
+  /// for powers of 1024. A fraction such as "1.5M" is allowed if the
+  /// result is a whole number of bytes.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// std::uint64_t cache_bytes = opt.arg.get<ByteSize>();
+  ///
+  struct ByteSize {
+    ByteSize(std::uint64_t bytes = 0) : bytes(bytes) {}
+    operator std::uint64_t() const { return bytes; }
+
+    std::uint64_t bytes;
+  };
+
+  template <>
+  struct Convert<ByteSize> {
+    static ConversionStatus parse(StringRef value, ByteSize &result) {
+      detail::Decimal number;
+      detail::Unit unit;
+      ConversionStatus status = detail::readWithUnit(value, detail::findSizeUnit, number, unit);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      unsigned long long bytes;
+      status = detail::scaleDecimal(number, unit.num, unit.den, bytes);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      return detail::toInteger(number.negative, bytes, result.bytes);
+    }
+  };
+
+  template <>
+  struct TypeName<ByteSize> {
+    static StringRef get() { return "size"; }
+  };
+
+  /// Durations are a number followed by a unit: ns, us, ms, s, min, h or d,
+  /// e.g. "250ms" or "1.5h". A number without a unit is a count of the
+  /// duration's own period. For integer durations the value must be a
+  /// whole number of periods, so "1500us" is not a valid milliseconds.
+  template <typename Rep, typename Period>
+  struct Convert<std::chrono::duration<Rep, Period>> {
+    static ConversionStatus parse(StringRef value, std::chrono::duration<Rep, Period> &result) {
+      detail::Decimal number;
+      detail::Unit unit;
+      ConversionStatus status = detail::readWithUnit(value, findUnit, number, unit);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      // Scale by (unit.num * Period::den) / (unit.den * Period::num),
+      // removing common factors so that the products are small
+      const unsigned long long a = detail::gcd(unit.num, Period::num);
+      const unsigned long long b = detail::gcd(unit.den, Period::den);
+      const unsigned long long num = (unit.num / a) * (Period::den / b);
+      const unsigned long long den = (unit.den / b) * (Period::num / a);
+
+      Rep count;
+      status = scale(number, num, den, count,
+                     std::integral_constant<bool, std::is_floating_point<Rep>::value>());
+      if (status == ConversionStatus::ok) {
+        result = std::chrono::duration<Rep, Period>(count);
+      }
+      return status;
+    }
+
+  private:
+    /// Units of time, or no unit for the duration's own period
+    static bool findUnit(StringRef suffix, detail::Unit &unit) {
+      if (suffix.empty()) {
+        unit = {"", Period::num, Period::den};
+        return true;
+      }
+      return detail::findTimeUnit(suffix, unit);
+    }
+
+    static ConversionStatus scale(const detail::Decimal &number, unsigned long long num,
+                                  unsigned long long den, Rep &count,
+                                  std::false_type /*is_floating_point*/) {
+      unsigned long long magnitude;
+      ConversionStatus status = detail::scaleDecimal(number, num, den, magnitude);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      return detail::toInteger(number.negative, magnitude, count);
+    }
+
+    static ConversionStatus scale(const detail::Decimal &number, unsigned long long num,
+                                  unsigned long long den, Rep &count,
+                                  std::true_type /*is_floating_point*/) {
+      count = static_cast<Rep>(detail::toLongDouble(number) * num / den);
+      return ConversionStatus::ok;
+    }
+  };
+
+  template <typename Rep, typename Period>
+  struct TypeName<std::chrono::duration<Rep, Period>> {
+    static StringRef get() { return "duration"; }
+  };
+
+  /// Strings are copied, including any whitespace
+  template <>
+  struct Convert<std::string> {
+    static ConversionStatus parse(StringRef value, std::string &result) {
+      result = value.str();
+      return ConversionStatus::ok;
+    }
+  };
+
+  namespace detail {
+    /// Convert a list of values, separated by the given character, into
+    /// a vector. Each element is converted in place with Convert<T>, and
+    /// empty elements are invalid.
+    ///
+    /// The separators are found with memchr, which is vectorised in
+    /// most C libraries, and the vector is allocated once.
+    template <typename T>
+    ConversionStatus convertList(StringRef value, char separator, std::vector<T> &result) {
+      result.clear();
+      result.reserve(static_cast<std::size_t>(std::count(value.begin(), value.end(), separator)) + 1);
+
+      const char *start = value.data();
+      const char *const end = value.data() + value.size();
+      while (true) {
+        const char *found = static_cast<const char *>(
+          std::memchr(start, separator, static_cast<std::size_t>(end - start)));
+        const char *stop = (found != nullptr) ? found : end;
+
+        const StringRef element(start, static_cast<std::size_t>(stop - start));
+        if (trim(element).empty()) {
+          return ConversionStatus::invalid;
+        }
+        T converted;
+        ConversionStatus status = Convert<T>::parse(element, converted);
+        if (status != ConversionStatus::ok) {
+          return status;
+        }
+        result.push_back(std::move(converted));
+
+        if (found == nullptr) {
+          return ConversionStatus::ok;
+        }
+        start = found + 1;
+      }
+    }
+  } // namespace detail
+
+  /// Lists of values separated by commas, e.g. "1,2,3"
+  template <typename T>
+  struct Convert<std::vector<T>> {
+    static ConversionStatus parse(StringRef value, std::vector<T> &result) {
+      return detail::convertList(value, ',', result);
+    }
+  };
+
+  template <typename T>
+  struct TypeName<std::vector<T>> {
+    static StringRef get() {
+      static const std::string name = "list of " + TypeName<T>::get().str();
+      return name;
+    }
+  };
+
+  /// A set of integers, stored as sorted closed intervals which
+  /// don't overlap or touch, so large ranges take little space.
+  /// Converted from values such as "0-1023,2048,4000-4095".
+  ///
+  /// Example
+  /// -------
+  ///
+  /// IntervalSet ranks = opt.arg;  // From "--ranks=0-3,8"
+  /// if (ranks.contains(rank)) {
+  ///   ...
+  /// }
+  /// for (long long r : ranks) {  // 0, 1, 2, 3, 8
+  ///   ...
+  /// }
+  ///
+  class IntervalSet {
+  public:
+    /// The integers from first to last, including both
+    struct Interval {
+      long long first;
+      long long last;
+    };
+
+    /// Iterates over the integers in the set, in increasing order
+    class const_iterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = long long;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const long long *;
+      using reference = const long long &;
+
+      const_iterator(std::vector<Interval>::const_iterator interval,
+                     std::vector<Interval>::const_iterator end)
+        : interval(interval), end(end), value((interval != end) ? interval->first : 0) {}
+
+      const long long &operator*() const { return value; }
+      const_iterator &operator++() {
+        if (value == interval->last) {
+          ++interval;
+          value = (interval != end) ? interval->first : 0;
+        } else {
+          ++value;
+        }
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator result = *this;
+        ++*this;
+        return result;
+      }
+      bool operator==(const const_iterator &other) const {
+        return (interval == other.interval) && (value == other.value);
+      }
+      bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+      std::vector<Interval>::const_iterator interval, end;
+      long long value;
+    };
+
+    /// Add the integers from first to last, including both.
+    /// Throws std::invalid_argument if last is less than first,
+    /// as converting "5-3" is an error.
+    void insert(long long first, long long last) {
+      if (last < first) {
+        ARGOPTS_THROW(std::invalid_argument("interval " + std::to_string(first) + "-" +
+                                            std::to_string(last) + " ends before it starts"));
+      }
+      ranges.push_back({first, last});
+      normalise();
+    }
+    void insert(long long value) { insert(value, value); }
+
+    /// True if value is in the set. Takes O(log n) time in the number of intervals
+    bool contains(long long value) const {
+      // The first interval starting after value
+      auto after = std::upper_bound(ranges.begin(), ranges.end(), value,
+                                    [](long long v, const Interval &range) {
+                                      return v < range.first;
+                                    });
+      return (after != ranges.begin()) && (value <= (after - 1)->last);
+    }
+
+    bool empty() const { return ranges.empty(); }
+
+    /// The number of integers in the set. This can be very large
+    unsigned long long count() const {
+      unsigned long long total = 0;
+      for (const Interval &range : ranges) {
+        total += static_cast<unsigned long long>(range.last) -
+          static_cast<unsigned long long>(range.first) + 1;
+      }
+      return total;
+    }
+
+    /// The intervals, sorted and separated by at least one integer
+    const std::vector<Interval> &intervals() const { return ranges; }
+
+    const_iterator begin() const { return const_iterator(ranges.begin(), ranges.end()); }
+    const_iterator end() const { return const_iterator(ranges.end(), ranges.end()); }
+
+  private:
+    friend struct Convert<IntervalSet>;
+
+    std::vector<Interval> ranges;
+
+    /// Sort the intervals and merge those which overlap or touch
+    void normalise() {
+      auto before = [](const Interval &a, const Interval &b) { return a.first < b.first; };
+      if (!std::is_sorted(ranges.begin(), ranges.end(), before)) {
+        std::sort(ranges.begin(), ranges.end(), before);
+      }
+      std::size_t merged = 0;
+      for (std::size_t n = 1; n < ranges.size(); n++) {
+        Interval &last = ranges[merged];
+        // Written so that neither side can overflow
+        if ((ranges[n].first <= last.last) || (ranges[n].first - 1 == last.last)) {
+          last.last = std::max(last.last, ranges[n].last);
+        } else {
+          ranges[++merged] = ranges[n];
+        }
+      }
+      if (!ranges.empty()) {
+        ranges.resize(merged + 1);
+      }
+    }
+  };
+
+  /// Interval sets are a list of integers or ranges "first-last",
+  /// separated by commas. Each integer can be written as for get<int>,
+  /// e.g. "0x100-0x1ff". Ranges are not expanded, so are read in one
+  /// pass over the characters.
+  template <>
+  struct Convert<IntervalSet> {
+    static ConversionStatus parse(StringRef value, IntervalSet &result) {
+      result.ranges.clear();
+      result.ranges.reserve(static_cast<std::size_t>(std::count(value.begin(), value.end(), ',')) + 1);
+
+      std::size_t start = 0;
+      while (true) {
+        std::size_t stop = value.find(',', start);
+        const StringRef element = detail::trim(value.substr(start, (stop == StringRef::npos) ?
+                                                                   StringRef::npos : stop - start));
+        // A '-' after the first character separates first and last
+        const std::size_t dash = element.empty() ? StringRef::npos : element.find('-', 1);
+        IntervalSet::Interval range;
+        ConversionStatus status = readInteger(element.substr(0, dash), range.first);
+        if (status != ConversionStatus::ok) {
+          return status;
+        }
+        range.last = range.first;
+        if (dash != StringRef::npos) {
+          status = readInteger(element.substr(dash + 1), range.last);
+          if (status != ConversionStatus::ok) {
+            return status;
+          }
+          if (range.last < range.first) {
+            return ConversionStatus::invalid;
+          }
+        }
+        result.ranges.push_back(range);
+
+        if (stop == StringRef::npos) {
+          break;
+        }
+        start = stop + 1;
+      }
+      result.normalise();
+      return ConversionStatus::ok;
+    }
+
+  private:
+    static ConversionStatus readInteger(StringRef text, long long &result) {
+      if (detail::trim(text).empty()) {
+        return ConversionStatus::invalid;
+      }
+      return detail::convertNumber(text, result);
+    }
+  };
+
+  template <>
+  struct TypeName<IntervalSet> {
+    static StringRef get() { return "integer set"; }
+  };
+
+  namespace detail {
+    /// Makes the contents of a file available, setting contents to refer
+    /// to them. Returns the owner of the contents, which keeps them
+    /// alive, or nullptr if the file can't be read.
+    ///
+    /// Regular files are mapped read-only into memory, so the contents
+    /// are not copied and pages are only read when used. Other files,
+    /// such as pipes, are read into a string.
+    inline std::shared_ptr<const void> readFile(const std::string &path, StringRef &contents) {
+#ifdef ARGOPTS_HAVE_MMAP
+      const int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return nullptr;
+      }
+      struct stat info;
+      if ((::fstat(fd, &info) == 0) && S_ISREG(info.st_mode) && (info.st_size > 0)) {
+        const std::size_t size = static_cast<std::size_t>(info.st_size);
+        void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+          ::close(fd); // The mapping doesn't need the descriptor
+          contents = StringRef(static_cast<const char *>(data), size);
+          return std::shared_ptr<const void>(data, [size](void *mapped) {
+              ::munmap(mapped, size);
+            });
+        }
+      }
+      ::close(fd);
+#endif
+      std::ifstream in(path, std::ios::binary);
+      if (!in) {
+        return nullptr;
+      }
+      auto text = std::make_shared<std::string>(std::istreambuf_iterator<char>(in),
+                                                std::istreambuf_iterator<char>());
+      if (in.bad()) {
+        return nullptr;
+      }
+      contents = *text;
+      return text;
+    }
+  } // namespace detail
+
+  /// Stores values as strings, and allows conversion
+  /// between types via string storage
+  ///
+  /// Any type can be assigned to a StringStore
+  /// provided that it can be streamed to a std::stringstream
+  /// ie implements the "<<" operator
+  ///
+  /// A StringStore can be assigned to any type which
+  /// can be streamed from a std::stringstream
+  /// ie implements the ">>" operator
+  ///
+  /// Integer and floating point types are converted without a stream,
+  /// which is much faster. Integers may be written in hex, octal or
+  /// binary ("0x1f", "0o17", "0b101") and with separators ("1_000_000").
+  /// Values out of range of the type are rejected.
+  ///
+  class StringStore {
+  public:
+    /// Called when a conversion fails, with the context given to the
+    /// ErrorHandler, the value (empty if missing), the expected type
+    /// and the reason for the failure
+    using ErrorFunction = void (*)(const void *context, StringRef value, StringRef type_name,
+                                   ConversionStatus status);
+
+    /// A function called when a conversion fails, and the context passed to it
+    ///
+    /// The handler doesn't own the context, so is two pointers in size
+    /// and copying it is cheap. The context must outlive the StringStore.
+    ///
+    /// Example
+    /// -------
+    ///
+    /// void report(const void *context, StringRef value, StringRef type_name,
+    ///             ConversionStatus status) {
+    ///   const Setting *setting = static_cast<const Setting*>(context);
+    ///   ...
+    /// }
+    ///
+    /// StringStore s("x", {report, &setting});
+    ///
+    struct ErrorHandler {
+      ErrorHandler() : function(nullptr), context(nullptr) {}
+      ErrorHandler(ErrorFunction function, const void *context = nullptr)
+        : function(function), context(context) {}
+
+      explicit operator bool() const { return function != nullptr; }
+      void operator()(StringRef value, StringRef type_name, ConversionStatus status) const {
+        function(context, value, type_name, status);
+      }
+
+      ErrorFunction function;
+      const void *context;
+    };
+    
+    StringStore(ErrorHandler handler = {}) : owner(), handler(std::move(handler)) {}
+    StringStore(const std::string &value, ErrorHandler handler = {}) : StringStore(StringRef(value), handler) {}
+    StringStore(const char *value, ErrorHandler handler = {}) : StringStore(StringRef(value), handler) {}
+    StringStore(StringRef value, ErrorHandler handler = {}) : owner(), handler(std::move(handler)) {
+      assign(value);
+    }
+
+    StringStore(const StringStore &other) : handler(other.handler) {
+      copyFrom(other);
+    }
+
+    StringStore(StringStore &&other) noexcept : handler(other.handler) {
+      moveFrom(other);
+    }
+
+    StringStore &operator=(const StringStore &other) {
+      if (this != &other) {
+        release();
+        copyFrom(other);
+        handler = other.handler;
+      }
+      return *this;
+    }
+
+    StringStore &operator=(StringStore &&other) noexcept {
+      if (this != &other) {
+        release();
+        moveFrom(other);
+        handler = other.handler;
+      }
+      return *this;
+    }
+
+    ~StringStore() { release(); }
+
+    /// Constructor from any type T
+    /// Tries to stream the input to a std::stringstream
+    /// and then saves the resulting string.
+    ///
+    /// Integers and floating point values are formatted directly,
+    /// giving the same text as a stream without its overhead.
+    /// Short results are held inside the StringStore without allocating.
+    template <typename T> StringStore(const T &inputvalue, ErrorHandler handler = {})
+      : owner(), handler(std::move(handler)) {
+      std::string text;
+      detail::format(inputvalue, text,
+                     std::integral_constant<bool, detail::IsFastNumber<T>::value>());
+      assign(text);
+    }
+
+    /// Create a StringStore which refers to the given characters
+    /// rather than copying them. The characters must outlive the
+    /// StringStore and any copies of it.
+    static StringStore borrow(StringRef value, ErrorHandler handler = {}) {
+      StringStore result(std::move(handler));
+      result.text = value;
+      return result;
+    }
+
+    /// Create a StringStore which refers to the given characters,
+    /// and shares ownership of the object containing them. Copies
+    /// share the same characters, which are released with the last copy.
+    static StringStore share(StringRef value, std::shared_ptr<const void> owner,
+                             ErrorHandler handler = {}) {
+      StringStore result = borrow(value, std::move(handler));
+      result.owner = std::move(owner);
+      return result;
+    }
+
+    /// Set the function called when a conversion fails
+    void setErrorHandler(ErrorHandler error_handler) {
+      handler = std::move(error_handler);
+    }
+
+    /// The stored value, without copying
+    StringRef view() const {
+      return text;
+    }
+
+    /// A copy of the stored value, which does not depend on
+    /// the lifetime of borrowed characters
+    std::string str() const { return view().str(); }
+
+    /// Cast operator, which allows this class to be
+    /// assigned to type T
+    ///
+    /// Example
+    /// -------
+    ///
+    /// StringStore s = "3.1415";
+    /// double val = s;
+    ///
+    ///
+    template <typename T> operator T() const { return get<T>(); }
+
+    /// Get the value as a specified type
+    ///
+    /// Example
+    /// -------
+    ///
+    /// StringStore s = "3.1415";
+    /// double val = s.get<double>();
+    ///
+    /// The string is converted on every call. To read a value
+    /// repeatedly, e.g. in a loop, convert it once with Converted<T>.
+    ///
+    template <typename T> T get() const {
+      Expected<T> result = tryGet<T>();
+      if (!result) {
+        handleError(TypeName<T>::get(), result.status());
+      }
+      return std::move(*result);
+    }
 
-  
-  /// This code from http://www.cplusplus.com/forum/beginner/175177/
-  std::string demangle( const char* mangled_name ) {
-    std::size_t len = 0 ;
-    int status = 0 ;
-    std::unique_ptr< char, decltype(&std::free) > ptr(
-                                                      __cxxabiv1::__cxa_demangle( mangled_name, nullptr, &len, &status ),
-                                                      &std::free ) ;
-    return ptr.get() ;
+    /// Get the value as a specified type, without throwing an exception
+    /// or calling the error handler if it can't be converted
+    ///
+    /// Example
+    /// -------
+    ///
+    /// StringStore s = "3.1415";
+    /// Expected<int> val = s.tryGet<int>();  // val.status() is invalid
+    /// int n = val.valueOr(3);
+    ///
+    template <typename T> Expected<T> tryGet() const {
+      StringRef value = view();
+      if (value.length() == 0) {
+        return ConversionStatus::missing;
+      }
+
+      T t;
+      ConversionStatus status = Convert<T>::parse(value, t);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      return t;
+    }
+
+    /// Get the value as a list of values separated by the given
+    /// character. Each element is converted as by get<T>(), and an
+    /// empty element is an error.
+    ///
+    /// Example
+    /// -------
+    ///
+    /// StringStore s = "1.5,2,2.5";
+    /// std::vector<double> values = s.getList<double>();
+    ///
+    /// StringStore p = "/usr/lib:/lib";
+    /// std::vector<std::string> paths = p.getList<std::string>(':');
+    ///
+    template <typename T> std::vector<T> getList(char separator = ',') const {
+      Expected<std::vector<T>> result = tryGetList<T>(separator);
+      if (!result) {
+        handleError(TypeName<std::vector<T>>::get(), result.status());
+      }
+      return std::move(*result);
+    }
+
+    /// Get the value as a list, without throwing an exception
+    /// or calling the error handler if it can't be converted
+    template <typename T> Expected<std::vector<T>> tryGetList(char separator = ',') const {
+      StringRef value = view();
+      if (value.length() == 0) {
+        return ConversionStatus::missing;
+      }
+      std::vector<T> result;
+      ConversionStatus status = detail::convertList(value, separator, result);
+      if (status != ConversionStatus::ok) {
+        return status;
+      }
+      return Expected<std::vector<T>>(std::move(result));
+    }
+
+    /// If the value is '@' followed by a file name, the contents of the
+    /// file. Otherwise the value itself.
+    ///
+    /// The file is read when this is called, by mapping it into memory
+    /// where possible, so large files are not copied. The result shares
+    /// the contents, which are released when it and any copies are
+    /// destroyed.
+    ///
+    /// Example
+    /// -------
+    ///
+    /// StringStore data = opt.arg.contents();  // From "--data=@/path/file.json"
+    /// parseJson(data.view());
+    ///
+    StringStore contents() const {
+      Expected<StringStore> result = tryContents();
+      if (!result) {
+        handleError("file", result.status());
+      }
+      return std::move(*result);
+    }
+
+    /// The contents of the file, as for contents(), without throwing an
+    /// exception or calling the error handler if it can't be read
+    Expected<StringStore> tryContents() const {
+      StringRef value = view();
+      if ((value.length() == 0) || (value[0] != '@')) {
+        return *this;
+      }
+      StringRef text;
+      std::shared_ptr<const void> file = detail::readFile(value.substr(1).str(), text);
+      if (!file) {
+        return ConversionStatus::unreadable;
+      }
+      return share(text, std::move(file), handler);
+    }
+
+    /// Values up to this length are copied into the StringStore
+    /// itself, without allocating
+    static constexpr std::size_t small_size = sizeof(std::shared_ptr<const void>);
+
+  private:
+    /// The value, which refers to small, to characters kept alive by
+    /// owner, or to borrowed characters
+    StringRef text;
+
+    /// Short copies are stored inside the StringStore, so don't need
+    /// an owner. Only one of these is used, so they share space
+    union {
+      std::shared_ptr<const void> owner; ///< Owns the characters in text, if not small
+      char small[sizeof(std::shared_ptr<const void>)]; ///< A short copied value
+    };
+
+    ErrorHandler handler;
+
+    /// True if the value is stored in small, rather than using owner
+    bool isSmall() const { return text.data() == small; }
+
+    /// Copy a value into small if it fits, otherwise into a shared
+    /// string. owner must be constructed and empty
+    void assign(StringRef value) {
+      if (value.size() <= sizeof(small)) {
+        owner.~shared_ptr();
+        std::memcpy(small, value.data(), value.size());
+        text = StringRef(small, value.size());
+      } else {
+        auto copy = std::make_shared<std::string>(value.data(), value.size());
+        text = *copy;
+        owner = std::move(copy);
+      }
+    }
+
+    /// Copy another value, when owner is not constructed
+    void copyFrom(const StringStore &other) {
+      if (other.isSmall()) {
+        std::memcpy(small, other.small, other.text.size());
+        text = StringRef(small, other.text.size());
+      } else {
+        new (&owner) std::shared_ptr<const void>(other.owner);
+        text = other.text;
+      }
+    }
+
+    /// Take another value, when owner is not constructed
+    void moveFrom(StringStore &other) {
+      if (other.isSmall()) {
+        copyFrom(other);
+      } else {
+        new (&owner) std::shared_ptr<const void>(std::move(other.owner));
+        text = other.text;
+      }
+    }
+
+    /// Destroy owner if it is in use
+    void release() {
+      if (!isSmall()) {
+        owner.~shared_ptr();
+      }
+    }
+
+    /// This always throws an exception. The user-supplied
+    /// handler handler may throw, but if not then std::invalid_argument is thrown.
+    void handleError(StringRef type_name, ConversionStatus status) const {
+      if (handler) {
+        handler(view(), type_name, status);
+      }
+      ARGOPTS_THROW(std::invalid_argument("could not convert " + detail::quoteValue(view()) +
+                                          " to " + type_name.str() + ": " + describe(status)));
+    }
+  };
+
+  template<> inline Expected<std::string> StringStore::tryGet<std::string>() const {
+    if (view().length() == 0) {
+      return ConversionStatus::missing;
+    }
+    return str();
   }
+
+  /// A value converted once from a StringStore, for code which reads
+  /// the same option many times. Conversion errors are reported by the
+  /// constructor, in the same way as StringStore::get<T>(), and reading
+  /// the value afterwards is a load.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// Converted<int> count(opt.arg);
+  /// for (int i = 0; i < count; i++) {
+  ///   ...
+  /// }
+  ///
+  template <typename T> class Converted {
+  public:
+    explicit Converted(const StringStore &store) : value(store.get<T>()) {}
+
+    const T &get() const { return value; }
+    operator const T &() const { return value; }
+
+  private:
+    T value;
+  };
+
+  /// Returns a text containing the command-line option and help message
+  /// No newline at the end
+  inline std::string usage(char shortopt, StringRef longopt, StringRef help) {
+    std::string result;
+
+    if (shortopt != 0) {
+      // Has a short option character
+      result += "-" + std::string(1, shortopt);
+      if (longopt.length() != 0) {
+        // Both short and long option, so separate
+        result += ", ";
+      }
+    }
+    if (longopt.length() != 0) {
+      // Has a long option name
+      result += "--" + longopt.str();
+    }
+    if (help.length() != 0) {
+      result += "\t\t" + help.str();
+    }
+    return result;
+  }
+
+  /// The values an option takes, which tells the parser which
+  /// arguments are values rather than options
+  ///
+  /// Example
+  /// -------
+  ///
+  ///   Parser parser {{'v', "verbose", "", Arity::flag},
+  ///                  {'n', "number", "[N]", Arity::required},
+  ///                  {0, "size", "[W H]", Arity::values(2)}};
+  ///
+  /// With these, "-v -n -5 --size 640 480" gives v with no value,
+  /// n with "-5", and two size options with "640" and "480".
+  ///
+  struct Arity {
+    enum Kind {
+      speculative, ///< Not known: the next argument is the value, but is also
+                   ///< scanned as an option itself
+      flag,        ///< No value, unless given with '='
+      required,    ///< Followed by a value, which is not scanned for options
+      optional     ///< A value only if given with '=', or attached to a short option
+    };
+
+    Arity(Kind kind = speculative) : kind(kind), count(kind == required ? 1 : 0) {}
+
+    /// Followed by the given number of values, each giving a separate Option
+    static Arity values(unsigned count) {
+      Arity result(count == 0 ? flag : required);
+      result.count = count;
+      return result;
+    }
+
+    Kind kind;      ///< How values are found
+    unsigned count; ///< Number of values, if required
+  };
+
+  /// Description of a command-line option to be matched,
+  /// as given to Parser
+  struct OptionSpec {
+    OptionSpec(char shortopt, const std::string &longopt, const std::string &help,
+               Arity arity = Arity())
+      : shortopt(shortopt), longopt(longopt), help(help), arity(arity) {}
+
+    /// Stores the values of an option into a variable, for options
+    /// added with Parser::bind or Parser::bindFlag
+    struct Binding {
+      using StoreFunction = void(*)(void *target, const StringStore &value);
+
+      Binding() : function(nullptr), target(nullptr) {}
+      Binding(StoreFunction function, void *target) : function(function), target(target) {}
+
+      explicit operator bool() const { return function != nullptr; }
+
+      StoreFunction function; ///< Converts the value and stores it in target
+      void *target;           ///< The variable, which must outlive the parser
+    };
+
+    char shortopt;       ///< A single character short option, or 0
+    std::string longopt; ///< A string used for the long option, or empty
+    std::string help;    ///< A help string
+    Arity arity;         ///< The values taken by the option
+    Binding binding;     ///< Where values are stored, if bound to a variable
+
+    /// Returns a text containing the command-line option and help message
+    /// No newline at the end
+    std::string usage() const { return ArgOpts::usage(shortopt, longopt, help); }
+  };
+
+  /// Structure representing a command-line option found by parsing
+  ///
+  /// The names refer to the option specification in the parser,
+  /// or to argv if the option was not known, rather than being copied.
+  /// The parser must therefore outlive the Options it returns.
+  /// Options can be copied freely; the value's error handler refers
+  /// to the same names, not to the Option.
+  ///
+  struct Option {
+    Option(char shortopt, StringRef longopt, StringRef help, int index = -1)
+      : shortopt(shortopt), index(index), longopt(longopt), help(help) {}
+    
+    char shortopt;       ///< A single character short option
+    int index;           ///< The index into argv where the option appears
+    StringRef longopt;   ///< A string used for the long option
+    StringRef help;      ///< A help string
+    StringStore arg;     ///< The argument following the option
+
+    /// Returns a text containing the command-line option and help message
+    /// No newline at the end
+    std::string usage() const { return ArgOpts::usage(shortopt, longopt, help); }
+  };
+
+  namespace detail {
+    // Error handlers for the values of Options, which put the
+    // option's usage into the exception. Each is given a context
+    // which outlives the Option, so that Options can be copied.
+
+    /// Throws an exception for a conversion error
+    inline void throwOptionError(StringRef value, StringRef type_name, ConversionStatus status,
+                                 const std::string &usage) {
+      if (status == ConversionStatus::out_of_range) {
+        std::string message = "Argument out of range: expected type " + type_name.str() +
+          " but got " + quoteValue(value) + "\n"
+          "usage: "+ usage + "\n";
+
+        ARGOPTS_THROW(std::invalid_argument(message));
+      }
+      if (status == ConversionStatus::unreadable) {
+        std::string message = "Could not read file " + quoteValue(value.substr(1)) + "\n"
+          "usage: "+ usage + "\n";
+
+        ARGOPTS_THROW(std::invalid_argument(message));
+      }
+      if (value.length() == 0) {
+        // Missing value
+        std::string message = "Missing argument, expected type " + type_name.str() + "\n"
+          "usage: "+ usage + "\n";
+
+        ARGOPTS_THROW(std::invalid_argument(message));
+      }
+
+      // Incorrect type
+      std::string message = "Invalid argument: expected type " + type_name.str() +
+        " but got " + quoteValue(value) + "\n"
+        "usage: "+ usage + "\n";
+
+      ARGOPTS_THROW(std::invalid_argument(message));
+    }
+
+    /// For known options. The context points to the Spec, such as
+    /// an OptionSpec or OptionInfo, in the parser
+    template <typename Spec>
+    void specError(const void *context, StringRef value, StringRef type_name,
+                   ConversionStatus status) {
+      const Spec *spec = static_cast<const Spec *>(context);
+      throwOptionError(value, type_name, status, usage(spec->shortopt, spec->longopt, spec->help));
+    }
+
+    template <typename Spec>
+    StringStore::ErrorHandler specErrorHandler(const Spec *spec) {
+      return {&specError<Spec>, spec};
+    }
+
+    /// Binding functions, which convert a value and store it
+    template <typename T>
+    void storeValue(void *target, const StringStore &value) {
+      *static_cast<T *>(target) = value.get<T>();
+    }
+
+    /// Flags are set to true, unless given a value such as "--verbose=no"
+    inline void storeFlag(void *target, const StringStore &value) {
+      *static_cast<bool *>(target) = value.view().empty() || value.get<bool>();
+    }
+
+    /// Store the value or the reason it could not be converted,
+    /// without throwing or calling the error handler
+    template <typename T>
+    void storeExpected(void *target, const StringStore &value) {
+      *static_cast<Expected<T> *>(target) = value.tryGet<T>();
+    }
+
+    inline void storeExpectedFlag(void *target, const StringStore &value) {
+      *static_cast<Expected<bool> *>(target) =
+        value.view().empty() ? Expected<bool>(true) : value.tryGet<bool>();
+    }
+
+    /// If the option is bound to a variable, stores the value and returns true.
+    /// Specs which cannot be bound, such as OptionInfo, return false
+    template <typename Spec>
+    bool storeBound(const Spec *, StringRef) { return false; }
+
+    inline bool storeBound(const OptionSpec *spec, StringRef value) {
+      if (!spec->binding) {
+        return false;
+      }
+      spec->binding.function(spec->binding.target,
+                             StringStore::borrow(value, specErrorHandler(spec)));
+      return true;
+    }
+
+    /// For unknown long options. The context points to the name,
+    /// which ends with a null or '=' (as in argv)
+    inline void longNameError(const void *context, StringRef value, StringRef type_name,
+                              ConversionStatus status) {
+      const char *name = static_cast<const char *>(context);
+      std::size_t length = 0;
+      while ((name[length] != 0) && (name[length] != '=')) {
+        length++;
+      }
+      throwOptionError(value, type_name, status, usage(0, StringRef(name, length), ""));
+    }
+
+    /// For unknown short options. The character is stored in the
+    /// context itself, since there is nothing for it to point to
+    inline void shortNameError(const void *context, StringRef value, StringRef type_name,
+                               ConversionStatus status) {
+      const char shortopt = static_cast<char>(reinterpret_cast<std::uintptr_t>(context));
+      throwOptionError(value, type_name, status, usage(shortopt, "", ""));
+    }
+
+    inline StringStore::ErrorHandler shortNameErrorHandler(char shortopt) {
+      return {&shortNameError, reinterpret_cast<const void *>(
+          static_cast<std::uintptr_t>(static_cast<unsigned char>(shortopt)))};
+    }
+
+    /// For options whose usage has been copied. The context points
+    /// to the usage, which ends with a null
+    inline void usageError(const void *context, StringRef value, StringRef type_name,
+                           ConversionStatus status) {
+      throwOptionError(value, type_name, status, static_cast<const char *>(context));
+    }
+  } // namespace detail
   
-#else
-  
-  std::string demangle( const char* name ) { return name ; }
-  
-#endif // _GNUG_
-  
-  /// Stores values as strings, and allows conversion
-  /// between types via string storage
+  namespace detail {
+    /// The arity of a matched option. Lookups whose options do not
+    /// declare an arity, and unknown options, are speculative
+    template <typename Spec>
+    Arity arityOf(const Spec *) { return Arity(); }
+
+    inline Arity arityOf(const OptionSpec *spec) {
+      return (spec != nullptr) ? spec->arity : Arity();
+    }
+
+    /// Visits an option with its values, as given by its arity.
+    /// If attached is true then value was given with '=' or after a
+    /// short option. next is the index of the first argument not yet
+    /// used, and is moved past any arguments taken as values.
+    /// following is argv[index + 1], measured once by the caller so
+    /// that a group of short options doesn't measure it for each one.
+    template <typename Found, typename Visitor>
+    void visitOption(Found found, char shortopt, StringRef longopt,
+                     StringRef value, bool attached, int index,
+                     int argc, char **argv, StringRef following, int &next, Visitor &visit) {
+      const Arity arity = arityOf(found);
+      switch (arity.kind) {
+      case Arity::speculative:
+        if (!attached && (next < argc)) {
+          // At this point we don't know if an argument is expected
+          // for this option so use the next argv value. Nothing has
+          // been taken as a value yet, so next is index + 1
+          value = following;
+        }
+        visit(found, shortopt, longopt, value, index);
+        return;
+      case Arity::flag:
+      case Arity::optional:
+        visit(found, shortopt, longopt, attached ? value : StringRef(), index);
+        return;
+      case Arity::required:
+        break;
+      }
+
+      unsigned remaining = arity.count;
+      if (attached) {
+        visit(found, shortopt, longopt, value, index);
+        remaining--;
+      }
+      for (; remaining > 0; remaining--) {
+        if (next >= argc) {
+          // Missing value, which is reported when it is converted
+          visit(found, shortopt, longopt, StringRef(), index);
+          return;
+        }
+        visit(found, shortopt, longopt, StringRef(argv[next++]), index);
+      }
+    }
+  } // namespace detail
+
+  /// Scans the given arguments for options, as passed to main(argc, argv)
   ///
-  /// Any type can be assigned to a StringStore
-  /// provided that it can be streamed to a std::stringstream
-  /// ie implements the "<<" operator
+  /// This contains the rules for splitting arguments into options and values,
+  /// and is shared by Parser and CompiledParser.
   ///
-  /// A StringStore can be assigned to any type which
-  /// can be streamed from a std::stringstream
-  /// ie implements the ">>" operator
+  /// Inputs
+  /// ------
+  ///
+  /// @param[in] argc    The number of arguments, including the command
+  /// @param[in] argv    C array of strings, of length argc
+  /// @param[in] lookup  Provides findLong(StringRef) and findShort(char),
+  ///                    which return a pointer to the matching option,
+  ///                    or nullptr if not known
+  /// @param[in] visit   Called for each option found, in order, as
+  ///                    visit(match, shortopt, longopt, value, index)
+  ///                    where match is the result of the lookup
+  ///
+  /// The names and values passed to visit are references into argv,
+  /// so no strings are copied.
+  ///
+  /// Options with an Arity take their values as it describes, and the
+  /// arguments used as values are skipped. A short option which takes
+  /// values can have the first attached, as in "-n5". Otherwise the
+  /// next argument is passed as the value but scanned as usual.
+  ///
+  template <typename Lookup, typename Visitor>
+  void scanArguments(int argc, char **argv, const Lookup &lookup, Visitor &&visit) {
+    // Loop through argv, skipping index 0
+    // since this is usually the command
+    for (int i = 1; i < argc; i++) {
+
+      if (argv[i][0] != '-') {
+        // Skip anything without a '-' at the start
+        continue;
+      }
+      if (argv[i][1] == 0) {
+        // Just a '-'; ignore
+        continue;
+      }
+      if ( std::isdigit(static_cast<unsigned char>(argv[i][1])) ) {
+        // A digit 0-9. Leading '-' is probably part of a number, so ignore
+        continue;
+      }
+
+      int next = i + 1; // The first argument not used as a value
+      const StringRef following = (next < argc) ? StringRef(argv[next]) : StringRef();
+
+      if (argv[i][1] == '-') {
+        // Starts with '--'
+        if (argv[i][2] == 0) {
+          // Stop on a '--'
+          break;
+        }
+        // A long option
+        StringRef longarg(&argv[i][2]);
+
+        StringRef argvalue;  // The value after '=', empty if none
+
+        // Check if longarg string contains a '='
+        std::size_t eq_pos = longarg.find('=');
+        const bool attached = (eq_pos != StringRef::npos);
+
+        if (attached) {
+          // longarg does contain '='
+          argvalue = longarg.substr(eq_pos+1); // After the '='
+          longarg = longarg.substr(0,eq_pos); // Before the '-'
+        }
+
+        detail::visitOption(lookup.findLong(longarg), 0, longarg, argvalue, attached,
+                            i, argc, argv, following, next, visit);
+      } else {
+        // A short option. This consists of a single '-'
+        // followed by one or more characters.
+        // Each of these characters is a separate option
+
+        StringRef shortarg(&argv[i][1]);
+
+        StringRef argvalue; // The value after '=', empty if none
+
+        // Check if shortarg string contains a '='
+        std::size_t eq_pos = shortarg.find('=');
+        const bool attached = (eq_pos != StringRef::npos);
+
+        if (attached) {
+          // shortarg does contain '='
+          argvalue = shortarg.substr(eq_pos+1); // After the '='
+          shortarg = shortarg.substr(0,eq_pos); // Before the '-'
+        }
+
+        // Iterate through each character
+        for (std::size_t n = 0; n < shortarg.size(); n++) {
+          const char c = shortarg[n];
+          auto found = lookup.findShort(c);
+
+          const Arity::Kind kind = detail::arityOf(found).kind;
+          if (!attached && (n + 1 < shortarg.size()) &&
+              ((kind == Arity::required) || (kind == Arity::optional))) {
+            // The rest of the argument is the value, as in "-n5"
+            detail::visitOption(found, c, StringRef(), shortarg.substr(n + 1), true,
+                                i, argc, argv, following, next, visit);
+            break;
+          }
+          if ((kind == Arity::flag) && (shortarg.size() > 1)) {
+            // In a group such as "-vn=5" the value is for the other
+            // options. A flag alone can still be given one, as in "-v=no"
+            detail::visitOption(found, c, StringRef(), StringRef(), false,
+                                i, argc, argv, following, next, visit);
+            continue;
+          }
+          detail::visitOption(found, c, StringRef(), argvalue, attached,
+                              i, argc, argv, following, next, visit);
+        }
+      }
+
+      // Skip the arguments used as values
+      i = next - 1;
+    }
+  }
+
+  /// The options found by parse(), stored contiguously
+  using options_list = std::vector<Option>;
+
+  /// How parsed values refer to the characters in argv
+  enum class ValueStorage {
+    copy,   ///< Each value is copied, so does not depend on argv
+    borrow  ///< Values refer to argv, which must outlive them (usually true)
+  };
+
+  namespace detail {
+    /// Scans arguments using scanArguments, and appends the Options
+    /// found to the given list.
+    ///
+    /// store(StringRef &name, StringRef value) converts each value into the
+    /// StringStore put in the Option. If the option is not known then name is
+    /// its long name in argv, which store can change to refer to other storage.
+    /// Otherwise name is empty, and the Option refers to the lookup's names.
+    ///
+    /// Each value is given an error handler which includes the option's
+    /// usage in exceptions.
+    template <typename Lookup, typename Store>
+    void appendOptions(options_list &options_found, int argc, char **argv,
+                       const Lookup &lookup, Store &&store) {
+      using Found = decltype(lookup.findShort(0));
+
+      scanArguments(argc, argv, lookup,
+                    [&options_found, &store, argc](Found found, char shortopt,
+                                                   StringRef longopt,
+                                                   StringRef argvalue, int index) {
+        if ((found != nullptr) && storeBound(found, argvalue)) {
+          // Stored into a variable, so not added to the list
+          return;
+        }
+        if (options_found.capacity() == 0) {
+          // Usually no more than one option per argument. Reserved only
+          // once needed, so that parses with only bound options don't allocate
+          options_found.reserve(argc - 1);
+        }
+        if (found != nullptr) {
+          // Found this option
+          StringRef no_name;
+          options_found.push_back({found->shortopt, found->longopt, found->help, index});
+          options_found.back().arg = store(no_name, argvalue);
+          options_found.back().arg.setErrorHandler(specErrorHandler(found));
+        } else {
+          // If not found, create a new option
+          // Here only one of the short or long option is set
+          StringStore arg = store(longopt, argvalue);
+          arg.setErrorHandler((shortopt != 0) ? shortNameErrorHandler(shortopt)
+                              : StringStore::ErrorHandler(&longNameError, longopt.data()));
+          options_found.push_back({shortopt, longopt, "", index});
+          options_found.back().arg = std::move(arg);
+        }
+      });
+    }
+  } // namespace detail
+
+  /// Scans arguments using scanArguments, and returns a list of the Options found
+  /// If an option is known to the lookup then the Option refers to its names
+  /// and help, otherwise a new Option is created with the short or long name.
+  ///
+  /// The lookup can return pointers to any type with shortopt, longopt
+  /// and help members, such as OptionSpec or OptionInfo
+  template <typename Lookup>
+  options_list collectOptions(int argc, char **argv, const Lookup &lookup,
+                              ValueStorage storage = ValueStorage::copy) {
+    options_list options_found; // The returned list
+    if (storage == ValueStorage::borrow) {
+      detail::appendOptions(options_found, argc, argv, lookup,
+                            [](StringRef &, StringRef value) {
+                              return StringStore::borrow(value);
+                            });
+    } else {
+      // Long values are copied into a buffer shared by the Options, rather
+      // than allocating for each. The buffer is never grown, since values
+      // refer to it, so a new one is started if it is full
+      std::shared_ptr<std::string> buffer;
+      auto makeRoom = [&](std::size_t length) {
+        if (!buffer || (buffer->capacity() - buffer->size() < length)) {
+          // Usually large enough for every value in the arguments
+          std::size_t size = length;
+          for (int i = 1; i < argc; i++) {
+            size += std::strlen(argv[i]) + 1;
+          }
+          buffer = std::make_shared<std::string>();
+          buffer->reserve(size);
+        }
+      };
+      // Appends to the buffer, which must have room
+      auto append = [&](StringRef value) {
+        const std::size_t start = buffer->size();
+        buffer->append(value.data(), value.size());
+        return StringRef(buffer->data() + start, value.size());
+      };
+
+      StringRef last_value;     // The last value stored, in argv
+      StringStore last;         // The copy of last_value
+      detail::appendOptions(options_found, argc, argv, lookup,
+                            [&](StringRef &name, StringRef value) {
+        if (name.empty()) {
+          if ((value.data() == last_value.data()) && (value.size() == last_value.size())) {
+            // Grouped short options share one copy of the value,
+            // so the cost doesn't depend on the number of options
+            return last;
+          }
+          last_value = value;
+          if (value.size() <= StringStore::small_size) {
+            last = StringStore(value);
+          } else {
+            makeRoom(value.size());
+            last = StringStore::share(append(value), buffer);
+          }
+          return last;
+        }
+        // An unknown long option. Copy its name and value together,
+        // since the Option can't refer to the name in argv. The name
+        // ends with a null, as error handlers expect
+        makeRoom(name.size() + 1 + value.size());
+        name = append(name);
+        buffer->push_back('\0');
+        return StringStore::share(append(value), buffer);
+      });
+    }
+    return options_found;
+  }
+
+  namespace detail {
+    /// Copies the names and help of Options into one buffer shared by
+    /// them all, so that they don't refer to the parser which found
+    /// them. Used when the parser is a temporary, as in
+    /// Parser().parse(argc, argv). The values refer to argv, and are
+    /// copied into the buffer too unless storage is ValueStorage::borrow.
+    /// Errors are reported with a copy of the usage.
+    inline void detachOptions(options_list &options, ValueStorage storage) {
+      const bool copy_values = (storage == ValueStorage::copy);
+      std::vector<std::string> usages;
+      usages.reserve(options.size());
+      std::size_t size = 0;
+      StringRef last_value;
+      for (auto &option : options) {
+        usages.push_back(option.usage());
+        size += option.longopt.size() + option.help.size() + usages.back().size() + 2;
+        const StringRef value = option.arg.view();
+        if (copy_values &&
+            ((value.data() != last_value.data()) || (value.size() != last_value.size()))) {
+          size += value.size();
+        }
+        last_value = value;
+      }
+
+      auto buffer = std::make_shared<std::string>();
+      buffer->reserve(size); // Never grown, since the Options refer to it
+      auto append = [&buffer](StringRef text) {
+        const std::size_t start = buffer->size();
+        buffer->append(text.data(), text.size());
+        return StringRef(buffer->data() + start, text.size());
+      };
+
+      last_value = StringRef();
+      StringRef last_copy; // Grouped short options share one copy of a value
+      for (std::size_t n = 0; n < options.size(); n++) {
+        Option &option = options[n];
+        option.longopt = append(option.longopt);
+        option.help = append(option.help);
+        const char *usage = append(usages[n]).data();
+        buffer->push_back('\0');
+
+        StringRef value = option.arg.view();
+        if (copy_values) {
+          if ((value.data() != last_value.data()) || (value.size() != last_value.size())) {
+            last_value = value;
+            last_copy = append(value);
+          }
+          value = last_copy;
+        }
+        option.arg = StringStore::share(value, buffer, {&usageError, usage});
+      }
+    }
+  } // namespace detail
+
+  /// Scans arguments using scanArguments, and calls visit(const Option &)
+  /// for each option found, in order. Nothing is accumulated: each Option
+  /// is built on the stack, with names and value referring to the lookup
+  /// or to argv, so no memory is allocated. Options bound to variables
+  /// are stored as in collectOptions, and not visited.
+  ///
+  /// The Option passed to visit can be copied, but like a borrowed
+  /// value it refers to argv, which must outlive the copy.
+  template <typename Lookup, typename Visitor>
+  void visitOptions(int argc, char **argv, const Lookup &lookup, Visitor &&visit) {
+    using Found = decltype(lookup.findShort(0));
+
+    scanArguments(argc, argv, lookup,
+                  [&visit](Found found, char shortopt, StringRef longopt,
+                           StringRef argvalue, int index) {
+      if (found != nullptr) {
+        if (detail::storeBound(found, argvalue)) {
+          return;
+        }
+        Option option(found->shortopt, found->longopt, found->help, index);
+        option.arg = StringStore::borrow(argvalue, detail::specErrorHandler(found));
+        visit(static_cast<const Option &>(option));
+      } else {
+        Option option(shortopt, longopt, "", index);
+        option.arg = StringStore::borrow(argvalue, (shortopt != 0)
+                                         ? detail::shortNameErrorHandler(shortopt)
+                                         : StringStore::ErrorHandler(&detail::longNameError,
+                                                                     longopt.data()));
+        visit(static_cast<const Option &>(option));
+      }
+    });
+  }
+
+  /// Storage reused between calls to parse, for programs which
+  /// parse many sets of arguments
+  ///
+  /// Values are copied into a block of memory owned by the session,
+  /// using a bump allocator, and the Options refer to them. The
+  /// results of a parse are all released together, by the next parse
+  /// or by reset(). After the first few calls the memory is reused,
+  /// so parsing doesn't need to allocate storage for the results
+  /// or values.
+  ///
+  /// Example
+  /// -------
   ///
-  class StringStore {
+  /// ArgOpts::Parser args = { {'h', "help", "print help message"} };
+  /// ArgOpts::ParseSession session;
+  ///
+  /// for (auto &command : commands) {
+  ///   for (auto &opt : session.parse(argc, argv, args)) {
+  ///     ...
+  ///   }
+  /// }
+  ///
+  class ParseSession {
   public:
-    using ErrorHandler = std::function<void(const std::string&, const std::string&)>;
-    
-    StringStore(ErrorHandler handler = {}) : handler(std::move(handler)) {}
-    StringStore(const std::string &value, ErrorHandler handler = {}) : value(value), handler(std::move(handler)) {}
-    StringStore(const char *value, ErrorHandler handler = {}) : value(value), handler(std::move(handler)) {}
+    ParseSession() = default;
 
-    /// Constructor from any type T
-    /// Tries to stream the input to a std::stringstream
-    /// and then saves the resulting string.
-    template <typename T> StringStore(const T &inputvalue) {
-      std::stringstream ss;
-      ss << inputvalue;
-      value = ss.str();
-    }
+    // Options refer to the session's memory, so it can't be copied
+    ParseSession(const ParseSession &) = delete;
+    ParseSession &operator=(const ParseSession &) = delete;
 
-    /// Cast operator, which allows this class to be
-    /// assigned to type T
-    ///
-    /// Example
-    /// -------
-    ///
-    /// StringStore s = "3.1415";
-    /// double val = s;
+    /// Looks for options in the given arguments, releasing the
+    /// results of any previous parse
     ///
+    /// Inputs
+    /// ------
     ///
-    template <typename T> operator T() { return get<T>(); }
-
-    /// Get the value as a specified type
+    /// @param[in] argc    The number of arguments, including the command
+    /// @param[in] argv    C array of strings, of length argc. This is not
+    ///                    used after parse returns
+    /// @param[in] parser  A Parser, CompiledParser, Schema or other lookup
     ///
-    /// Example
+    /// Returns
     /// -------
     ///
-    /// StringStore s = "3.1415";
-    /// double val = s.get<double>();
+    /// The Options found, which are valid until the next call to
+    /// parse() or reset(), or until the session is destroyed. They
+    /// refer to the parser's names, so it must outlive them too.
     ///
-    template <typename T> T get() {
-      if (value.length() == 0) {
-        handleError(demangle(typeid(T).name()));
-      }
+    template <typename Lookup>
+    const options_list &parse(int argc, char **argv, const Lookup &parser) {
+      reset();
+      StringRef last_value; // Grouped short options share a value
+      StringRef last_copy;
+      detail::appendOptions(options, argc, argv, parser, [&](StringRef &name, StringRef value) {
+          if (!name.empty()) {
+            name = copy(name);
+          }
+          if ((value.data() != last_value.data()) || (value.size() != last_value.size())) {
+            last_value = value;
+            last_copy = copy(value);
+          }
+          return StringStore::borrow(last_copy);
+        });
+      return options;
+    }
 
-      T t;
-      std::stringstream ss(value);
-      ss >> t;
-      
-      // Check if the parse failed
-      if (ss.fail()) {
-        handleError(demangle(typeid(T).name()));
-      }
-      // Check if there are characters remaining
-      std::string remainder;
-      std::getline(ss, remainder);
-      for (const char &ch : remainder) {
-        if (!std::isspace(static_cast<unsigned char>(ch))) {
-          // Meaningful character not parsed
-          handleError(demangle(typeid(T).name()));
+    // The results refer to the parser, so a temporary can't be used
+    template <typename Lookup>
+    const options_list &parse(int argc, char **argv, const Lookup &&parser) = delete;
+
+    /// The Options found by the last call to parse()
+    const options_list &options_found() const { return options; }
+
+    /// Release all results and values. The memory is kept for reuse
+    void reset() {
+      options.clear();
+      if (blocks.size() > 1) {
+        // Replace the blocks with a single block large enough for them all
+        std::size_t total = 0;
+        for (auto &block : blocks) {
+          total += block.size;
         }
+        blocks.clear();
+        blocks.push_back(Block(total));
       }
-      
-      return t;
+      used = 0;
     }
 
   private:
-    std::string value; ///< The internal data store
-    ErrorHandler handler;
+    /// A block of memory for the bump allocator
+    struct Block {
+      explicit Block(std::size_t size) : data(new char[size]), size(size) {}
+      std::unique_ptr<char[]> data;
+      std::size_t size;
+    };
 
-    /// This always throws an exception. The user-supplied
-    /// handler handler may throw, but if not then std::invalid_argument is thrown.
-    void handleError(const std::string &type_name) {
-      if (handler) {
-        handler(value, type_name);
+    options_list options; ///< The results, whose capacity is reused
+    std::vector<Block> blocks; ///< Memory for values. Only the last block is in use
+    std::size_t used = 0; ///< Number of bytes used in the last block
+
+    /// Copy a value into the session's memory, with a null terminator
+    StringRef copy(StringRef value) {
+      const std::size_t needed = value.size() + 1;
+      if (blocks.empty() || (blocks.back().size - used < needed)) {
+        // Start a new block, at least double the size of the last
+        std::size_t size = blocks.empty() ? 4096 : 2 * blocks.back().size;
+        while (size < needed) {
+          size *= 2;
+        }
+        blocks.push_back(Block(size));
+        used = 0;
       }
-      throw std::invalid_argument("could not convert '" + value + "' to " + type_name);
+      char *start = blocks.back().data.get() + used;
+      std::memcpy(start, value.data(), value.size());
+      start[value.size()] = 0;
+      used += needed;
+      return {start, value.size()};
     }
   };
 
-  template<> std::string StringStore::get<std::string>() {
-    if (value.length() == 0) {
-      handleError("string");
-    }
-    return value;
-  }
-  
-  /// Structure representing a command-line option
+  /// An immutable set of options, created by Parser::freeze()
   ///
+  /// The options are stored contiguously, and looked up through
+  /// flat tables of indices into that storage, so a CompiledParser
+  /// can be copied and shared freely. Parsing is the same as Parser.
   ///
-  struct Option {
-    Option(char shortopt, const std::string &longopt, const std::string &help, int index = -1)
-      : shortopt(shortopt), longopt(longopt), help(help), index(index) {}
-    
-    char shortopt;       ///< A single character short option
-    std::string longopt; ///< A string used for the long option
-    std::string help;    ///< A help string
-    int index;           ///< The index into argv where the option appears
-    StringStore arg;     ///< The argument following the option
+  /// Example
+  /// -------
+  ///
+  /// Parser args = { {'h', "help", "print help message"} };
+  /// const CompiledParser compiled = args.freeze();
+  ///
+  /// for (auto &opt : compiled.parse(argc, argv)) {
+  ///   ...
+  /// }
+  ///
+  class CompiledParser {
+  public:
+    using options_list = ArgOpts::options_list;
 
-    /// Returns a text containing the command-line option and help message
-    /// No newline at the end
-    std::string usage() const {
-      std::string result;
+    /// Construct from a range of OptionSpec objects
+    template <typename Iterator>
+    CompiledParser(Iterator first, Iterator last) : options(first, last) {
+      // Long names are stored in a power of two sized table, at most half full
+      std::size_t size = 2;
+      while (size < 2 * options.size()) {
+        size *= 2;
+      }
+      long_slots.assign(size, LongSlot());
 
-      if (shortopt != 0) {
-        // Has a short option character
-        result += "-" + std::string(1, shortopt);
-        if (longopt.length() != 0) {
-          // Both short and long option, so separate
-          result += ", ";
-        }
+      std::size_t names_length = 0;
+      for (auto &option : options) {
+        names_length += option.longopt.length();
       }
-      if (longopt.length() != 0) {
-        // Has a long option name
-        result += "--" + longopt;
+      names.reserve(names_length);
+
+      for (std::size_t n = 0; n < options.size(); n++) {
+        const OptionSpec &option = options[n];
+        if ((option.shortopt != 0) &&
+            (short_slots[static_cast<unsigned char>(option.shortopt)] == 0)) {
+          short_slots[static_cast<unsigned char>(option.shortopt)] = static_cast<std::uint32_t>(n + 1);
+        }
+        if (option.longopt.length() != 0) {
+          LongSlot &slot = long_slots[findSlot(option.longopt)];
+          if (slot.index == 0) {
+            // If already present then the first option takes precedence
+            slot.offset = static_cast<std::uint32_t>(names.size());
+            slot.length = static_cast<std::uint32_t>(option.longopt.length());
+            slot.index = static_cast<std::uint32_t>(n + 1);
+            names += option.longopt;
+          }
+        }
       }
-      if (help.length() != 0) {
-        result += "\t\t" + help;
+    }
+
+    /// Constructor with list of options
+    CompiledParser(std::initializer_list<OptionSpec> options)
+      : CompiledParser(options.begin(), options.end()) {}
+
+    /// Returns a formatted string, listing the known options
+    std::string printOptions() const {
+      std::string result;
+
+      for (auto &it : options) {
+        result += it.usage() + "\n";
       }
       return result;
     }
-  };
 
-  /// A functor which is called by StringStore
-  /// when an error occurs. By storing a reference
-  /// to the Option object, a useful error message
-  /// can be put into an exception.
-  struct OptionErrorHandler {
-    OptionErrorHandler(const Option &option) : option(option) {}
-    
-    void operator()(const std::string &value, const std::string &type_name) {
-      if (value.length() == 0) {
-        // Missing value
-        std::string message = "Missing argument, expected type " + type_name + "\n"
-          "usage: "+ option.usage() + "\n";
-        
-        throw std::invalid_argument(message);
-      }
+    /// Looks for options in the given arguments. See Parser::parse
+    options_list parse(int argc, char **argv,
+                       ValueStorage storage = ValueStorage::copy) const & {
+      return collectOptions(argc, argv, *this, storage);
+    }
 
-      // Incorrect type
-      std::string message = "Invalid argument: expected type " + type_name +
-        " but got '"+ value + "'\n"
-        "usage: "+ option.usage() + "\n";
-      
-      throw std::invalid_argument(message);
+    options_list parse(int argc, char **argv,
+                       ValueStorage storage = ValueStorage::copy) const && {
+      options_list result = collectOptions(argc, argv, *this, ValueStorage::borrow);
+      detail::detachOptions(result, storage);
+      return result;
     }
+
+    /// Calls visit(const Option &) for each option found. See Parser::parse
+    template <typename Visitor>
+    void parse(int argc, char **argv, Visitor &&visit) const {
+      visitOptions(argc, argv, *this, std::forward<Visitor>(visit));
+    }
+
+    /// Find the option with the given long name, or nullptr
+    const OptionSpec *findLong(StringRef longopt) const {
+      return entry(long_slots[findSlot(longopt)].index);
+    }
+
+    /// Find the option with the given short name, or nullptr
+    const OptionSpec *findShort(char shortopt) const {
+      return entry(short_slots[static_cast<unsigned char>(shortopt)]);
+    }
+
   private:
-    const Option &option;
+    std::vector<OptionSpec> options; ///< The known options, in the order given
+
+    /// The long names, stored one after another without separators,
+    /// so that probing the table doesn't follow a pointer per name
+    std::string names;
+
+    /// A long name in names, and the option it belongs to
+    struct LongSlot {
+      LongSlot() : offset(0), length(0), index(0) {}
+
+      std::uint32_t offset; ///< Start of the name in names
+      std::uint32_t length; ///< Length of the name
+      std::uint32_t index;  ///< Index into options plus one, or zero if empty
+    };
+
+    /// Open addressing hash table of long names
+    std::vector<LongSlot> long_slots;
+
+    /// Short option characters to index into options plus one, or zero
+    std::uint32_t short_slots[256] = {};
+
+    /// Convert a slot value into a pointer to the option
+    const OptionSpec *entry(std::uint32_t slot) const {
+      if (slot == 0) {
+        return nullptr;
+      }
+      return &options[slot - 1];
+    }
+
+    /// Find the slot in long_slots which contains the given name,
+    /// or the empty slot where it would be inserted
+    std::size_t findSlot(StringRef longopt) const {
+      const std::size_t mask = long_slots.size() - 1;
+      std::size_t slot = StringRefHash()(longopt) & mask;
+      while (long_slots[slot].index != 0) {
+        const LongSlot &entry = long_slots[slot];
+        if ((entry.length == longopt.size()) &&
+            (std::memcmp(names.data() + entry.offset, longopt.data(), entry.length) == 0)) {
+          break;
+        }
+        slot = (slot + 1) & mask; // Linear probing
+      }
+      return slot;
+    }
   };
-  
+
   /// Command-line argument options parser
   /// A simple parser for C++11
   ///
@@ -234,7 +2651,8 @@ namespace ArgOpts {
   ///
   /// Simple use to parse arguments
   ///
-  /// for (auto &opt : ArgOpts::Parser().parse(argc, argv)) {
+  /// ArgOpts::Parser parser;
+  /// for (auto &opt : parser.parse(argc, argv)) {
   ///   if ((opt.shortopt == 'h') ||
   ///       (opt.longopt == "help")) {
   ///     std::cout << "Usage:\n" << argv[0] << " [options]\n";
@@ -288,7 +2706,39 @@ namespace ArgOpts {
     Parser() {}
 
     /// Constructor with list of options
-    Parser(std::initializer_list<Option> options) : options(options) {}
+    Parser(std::initializer_list<OptionSpec> options) : options(options) {
+      reindex();
+    }
+
+    /// Copying rebuilds the lookup index, so that it
+    /// refers to the copied options rather than the original
+    Parser(const Parser &other) : options(other.options) {
+      reindex();
+    }
+
+    /// Moving also rebuilds both indices, so that neither parser
+    /// refers to options which now belong to the other
+    Parser(Parser &&other) : options(std::move(other.options)) {
+      reindex();
+      other.reindex();
+    }
+
+    Parser &operator=(Parser &&other) {
+      if (this != &other) {
+        options = std::move(other.options);
+        reindex();
+        other.reindex();
+      }
+      return *this;
+    }
+
+    Parser &operator=(const Parser &other) {
+      if (this != &other) {
+        options = other.options;
+        reindex();
+      }
+      return *this;
+    }
 
     /// Add a command-line option to match
     ///
@@ -300,9 +2750,70 @@ namespace ArgOpts {
     /// @param[in] longopt     A longer name for the same option. Set to an empty
     /// string for no long name
     /// @param[in] help        A short help message, briefly describing the option
+    /// @param[in] arity       The values the option takes. By default the next
+    /// argument is used as a value but is also scanned for options
     ///
-    void add(char shortopt, const std::string &longopt, const std::string &help) {
-      options.push_back({shortopt, longopt, help});
+    void add(char shortopt, const std::string &longopt, const std::string &help,
+             Arity arity = Arity()) {
+      options.push_back({shortopt, longopt, help, arity});
+      index(options.back());
+    }
+
+    /// Add an option whose value is converted and stored into a variable
+    /// as it is parsed, rather than being returned by parse(). The value
+    /// is converted with Convert<T>, and is required, so the next argument
+    /// is always taken as the value. If the option is repeated then the
+    /// last value is kept. Conversion errors throw as from StringStore::get,
+    /// unless the variable is an Expected<T>, which holds the
+    /// ConversionStatus instead so that parse() doesn't throw.
+    ///
+    /// The variable must outlive the parser, and any copies of it.
+    ///
+    /// Example
+    /// -------
+    ///
+    ///   int number = 1;
+    ///   bool verbose = false;
+    ///   Parser parser;
+    ///   parser.bind('n', "number", &number, "[N] number of things");
+    ///   parser.bindFlag('v', "verbose", &verbose, "print more");
+    ///   auto unbound = parser.parse(argc, argv);  // Only other options
+    ///
+    ///   Expected<double> scale = 1.0;
+    ///   parser.bind('s', "scale", &scale, "[X] scale factor");
+    ///   parser.parse(argc, argv);
+    ///   if (!scale) { ... }  // scale.status() says why
+    ///
+    template <typename T>
+    void bind(char shortopt, const std::string &longopt, T *target,
+              const std::string &help = "") {
+      options.push_back({shortopt, longopt, help, Arity::required});
+      options.back().binding = {&detail::storeValue<T>, target};
+      index(options.back());
+    }
+
+    template <typename T>
+    void bind(char shortopt, const std::string &longopt, Expected<T> *target,
+              const std::string &help = "") {
+      options.push_back({shortopt, longopt, help, Arity::required});
+      options.back().binding = {&detail::storeExpected<T>, target};
+      index(options.back());
+    }
+
+    /// Add a flag which sets a bool to true when present. A value can
+    /// be given with '=', as in "--verbose=no", which is converted to bool
+    void bindFlag(char shortopt, const std::string &longopt, bool *target,
+                  const std::string &help = "") {
+      options.push_back({shortopt, longopt, help, Arity::flag});
+      options.back().binding = {&detail::storeFlag, target};
+      index(options.back());
+    }
+
+    void bindFlag(char shortopt, const std::string &longopt, Expected<bool> *target,
+                  const std::string &help = "") {
+      options.push_back({shortopt, longopt, help, Arity::flag});
+      options.back().binding = {&detail::storeExpectedFlag, target};
+      index(options.back());
     }
 
     /// Returns a formatted string, listing the known options
@@ -315,7 +2826,7 @@ namespace ArgOpts {
       return result;
     }
 
-    using options_list = std::list<Option>;
+    using options_list = ArgOpts::options_list;
 
     /// Looks for options in the given arguments,
     /// as passed to main(argc, argv)
@@ -329,132 +2840,339 @@ namespace ArgOpts {
     /// Returns
     /// -------
     ///
-    /// A list of Option objects, in the order in which they
-    /// appear in the arguments
+    /// A vector of Option objects, in the order in which they
+    /// appear in the arguments. Options added with bind() or
+    /// bindFlag() are stored into their variables instead, during
+    /// the scan, so are not included.
+    ///
+    /// By default each Option's value is a copy of the text in argv.
+    /// If storage is ValueStorage::borrow then values refer to argv
+    /// without copying, which is safe if argv outlives the options,
+    /// as the argv passed to main does. StringStore::view() then
+    /// gives access to the value without any allocation.
     ///
-    options_list parse(int argc, char **argv) {
-      options_list options_found; // The returned list
+    /// The Options refer to the parser's names and help rather than
+    /// copying them, so the parser must outlive them. When called on a
+    /// temporary, as in Parser().parse(argc, argv), the names and help
+    /// are copied instead, into one buffer shared by the Options.
+    ///
+    options_list parse(int argc, char **argv,
+                       ValueStorage storage = ValueStorage::copy) const & {
+      return collectOptions(argc, argv, *this, storage);
+    }
 
-      // Loop through argv, skipping index 0
-      // since this is usually the command
-      for (int i = 1; i < argc; i++) {
+    options_list parse(int argc, char **argv,
+                       ValueStorage storage = ValueStorage::copy) const && {
+      options_list result = collectOptions(argc, argv, *this, ValueStorage::borrow);
+      detail::detachOptions(result, storage);
+      return result;
+    }
 
-        if (argv[i][0] != '-') {
-          // Skip anything without a '-' at the start
-          continue;
-        }
-        if (argv[i][1] == 0) {
-          // Just a '-'; ignore
-          continue;
-        }
-        if ( std::isdigit(static_cast<unsigned char>(argv[i][1])) ) {
-          // A digit 0-9. Leading '-' is probably part of a number, so ignore
-          continue;
+    /// Looks for options in the given arguments, and calls visit for
+    /// each one as it is found, rather than returning a list. Nothing
+    /// is stored, so no memory is allocated.
+    ///
+    /// The Option passed to visit(const Option &) has the names and
+    /// argv index, and a value which refers to argv without copying.
+    /// Options bound to variables are stored, and not visited.
+    ///
+    /// Example
+    /// -------
+    ///
+    ///   int number = 0;
+    ///   parser.parse(argc, argv, [&](const ArgOpts::Option &opt) {
+    ///     if (opt.shortopt == 'n') {
+    ///       number = opt.arg;
+    ///     }
+    ///   });
+    ///
+    template <typename Visitor>
+    void parse(int argc, char **argv, Visitor &&visit) const {
+      visitOptions(argc, argv, *this, std::forward<Visitor>(visit));
+    }
+
+    /// Returns an immutable copy of the options, which can be
+    /// used to parse many sets of arguments. Later calls to add()
+    /// do not change the CompiledParser
+    CompiledParser freeze() const {
+      return CompiledParser(options.begin(), options.end());
+    }
+
+    /// Find the option with the given long name, or nullptr
+    const OptionSpec *findLong(StringRef longopt) const {
+      auto found = long_index.find(longopt);
+      if (found == long_index.end()) {
+        return nullptr;
+      }
+      return found->second;
+    }
+
+    /// Find the option with the given short name, or nullptr
+    const OptionSpec *findShort(char shortopt) const {
+      return short_index[static_cast<unsigned char>(shortopt)];
+    }
+
+  private:
+    std::list<OptionSpec> options; ///< The options known about from construction or add() calls
+
+    /// Long option names to entries in options. Elements of a std::list
+    /// are never moved, so the pointers and the names they contain
+    /// stay valid as options are added
+    std::unordered_map<StringRef, const OptionSpec*, StringRefHash> long_index;
+
+    /// Short option characters to entries in options, or nullptr
+    const OptionSpec *short_index[256] = {};
+
+    /// Add an option to the lookup indices. If the short or long name is
+    /// already known then the first option added takes precedence
+    void index(const OptionSpec &option) {
+      if (option.shortopt != 0) {
+        const OptionSpec *&slot = short_index[static_cast<unsigned char>(option.shortopt)];
+        if (slot == nullptr) {
+          slot = &option;
         }
-        if (argv[i][1] == '-') {
-          // Starts with '--'
-          if (argv[i][2] == 0) {
-            // Stop on a '--'
-            break;
-          }
-          // A long option
-          std::string longarg = std::string(&argv[i][2]);
-
-          std::string argvalue;  // The next entry in argv, empty if none
-          
-          // Check if longarg string contains a '='
-          std::size_t eq_pos = longarg.find_first_of('=');
-          
-          if (eq_pos != std::string::npos) {
-            // longarg does contain '='
-            argvalue = longarg.substr(eq_pos+1); // After the '='
-            longarg = longarg.substr(0,eq_pos); // Before the '-'
-            
-          } else {
-            // No '=', so use next argument
-            
-            if (i != argc - 1) {
-              // inputs still remaining. At this point we don't know if an argument
-              // is expected for this option so use the next argv value
-              argvalue = std::string(argv[i + 1]);
-            }
-          }
-          
-          bool matched = false;
-          for (auto &it : options) {
-            if (it.longopt == longarg) {
-              // Found this option
-              Option option = it;
-              option.index = i;
-              options_found.push_back(option);
-              matched = true;
-              break;
-            }
-          }
-          if (!matched) {
-            // If not found, create a new option
-            // Here the short option is set to zero
-            options_found.push_back({0, longarg, "", i});
-          }
-          
-          // Create an error handler object which is called if there is a conversion error
-          Option &option = options_found.back();
-          option.arg = StringStore(argvalue, OptionErrorHandler(option));
-        } else {
-          // A short option. This consists of a single '-'
-          // followed by one or more characters.
-          // Each of these characters is a separate option
-
-          std::string shortarg = std::string(&argv[i][1]);
-
-          std::string argvalue; // The next entry in argv, empty if none
-          
-          // Check if shortarg string contains a '='
-          std::size_t eq_pos = shortarg.find_first_of('=');
-          
-          if (eq_pos != std::string::npos) {
-            // shortarg does contain '='
-            argvalue = shortarg.substr(eq_pos+1); // After the '='
-            shortarg = shortarg.substr(0,eq_pos); // Before the '-'
-          } else {
-            if (i != argc - 1) {
-              // inputs still remaining. At this point we don't know if an
-              // argument
-              // is expected for this option so use the next argv value
-              argvalue = std::string(argv[i + 1]);
-            }
-          }
+      }
+      if (option.longopt.length() != 0) {
+        long_index.emplace(option.longopt, &option);
+      }
+    }
 
-          // Iterate through each character
-          for (char c : shortarg) {
-            bool matched = false;
-            for (auto &it : options) {
-              if (it.shortopt == c) {
-                // Found this option
-                Option option = it;
-                option.index = i;
-                options_found.push_back(option);
-                matched = true;
-                break;
-              }
-            }
-            if (!matched) {
-              // If not found, create a new option
-              // Here the long option is empty
-              options_found.push_back({c, "", "", i});
-            }
-
-            // Create an error handler object which is called if there is a conversion error
-            Option &option = options_found.back();
-            option.arg = StringStore(argvalue, OptionErrorHandler(option));
-          }
+    /// Rebuild the lookup indices from the options list
+    void reindex() {
+      long_index.clear();
+      std::fill(std::begin(short_index), std::end(short_index), nullptr);
+      for (auto &it : options) {
+        index(it);
+      }
+    }
+  };
+
+  /// Description of an option known at compile time, as used by Schema
+  struct OptionInfo {
+    char shortopt;       ///< A single character short option, or 0
+    const char *longopt; ///< The long option name, or ""
+    const char *help;    ///< A help string
+  };
+
+  namespace detail {
+    /// A sequence of indices 0, 1, ..., N-1 (std::index_sequence is C++14)
+    template <std::size_t... Indices> struct IndexSequence {};
+
+    /// Appends Second to First, offset by the length of First
+    template <typename First, typename Second> struct JoinIndexSequences;
+
+    template <std::size_t... First, std::size_t... Second>
+    struct JoinIndexSequences<IndexSequence<First...>, IndexSequence<Second...>> {
+      using type = IndexSequence<First..., (sizeof...(First) + Second)...>;
+    };
+
+    /// Built from two halves, so the instantiation depth is logarithmic
+    /// in N and large schemas stay within the compiler's limits
+    template <std::size_t N>
+    struct MakeIndexSequence
+      : JoinIndexSequences<typename MakeIndexSequence<N / 2>::type,
+                           typename MakeIndexSequence<N - N / 2>::type> {};
+
+    template <> struct MakeIndexSequence<0> { using type = IndexSequence<>; };
+    template <> struct MakeIndexSequence<1> { using type = IndexSequence<0>; };
+
+    /// The hash of an option's long name, as a compile-time constant
+    template <typename Opt> struct LongHash {
+      static constexpr std::uint32_t value = hashName(Opt::longopt);
+    };
+
+    /// The first of two indices which is not -1
+    constexpr int earliestIndex(int a, int b) { return (a >= 0) ? a : b; }
+
+    /// The short names of a list of options, as compile-time constants
+    template <typename... Opts> struct ShortNames {
+      static constexpr char names[sizeof...(Opts)] = {Opts::shortopt...};
+
+      /// The first option in [first, last) with short name c, or -1.
+      /// Splits the range, so the recursion depth is logarithmic
+      static constexpr int find(char c, std::size_t first, std::size_t last) {
+        return ((c == 0) || (last <= first)) ? -1
+          : (last - first == 1) ? ((names[first] == c) ? static_cast<int>(first) : -1)
+          : earliestIndex(find(c, first, (first + last) / 2), find(c, (first + last) / 2, last));
+      }
+    };
+
+    template <typename... Opts>
+    constexpr char ShortNames<Opts...>::names[sizeof...(Opts)];
+
+    /// The smallest power of two which is at least n
+    constexpr std::size_t powerOfTwoAtLeast(std::size_t n, std::size_t size = 1) {
+      return (size >= n) ? size : powerOfTwoAtLeast(n, 2 * size);
+    }
+
+    /// The long names of a list of options, as compile-time constants
+    template <typename... Opts> struct LongNames {
+      static constexpr std::size_t count = sizeof...(Opts);
+
+      /// Number of hash buckets, at least twice the number of options
+      static constexpr std::size_t size = powerOfTwoAtLeast(2 * count);
+
+      static constexpr std::uint32_t hashes[sizeof...(Opts)] = {LongHash<Opts>::value...};
+      static constexpr bool named[sizeof...(Opts)] = {(Opts::longopt[0] != 0)...};
+
+      /// The bucket for a hash. The high bits are mixed in since
+      /// the low bits of the hash alone are poorly distributed
+      static constexpr std::size_t bucket(std::uint32_t hash) {
+        return (hash ^ (hash >> 16)) & (size - 1);
+      }
+
+      /// The first option in [first, last) whose name is in bucket b, or -1
+      /// Splits the range, so the recursion depth is logarithmic
+      static constexpr int find(std::size_t b, std::size_t first, std::size_t last) {
+        return (last <= first) ? -1
+          : (last - first == 1) ? ((named[first] && (bucket(hashes[first]) == b))
+                                   ? static_cast<int>(first) : -1)
+          : earliestIndex(find(b, first, (first + last) / 2), find(b, (first + last) / 2, last));
+      }
+    };
+
+    template <typename... Opts>
+    constexpr std::uint32_t LongNames<Opts...>::hashes[sizeof...(Opts)];
+
+    template <typename... Opts>
+    constexpr bool LongNames<Opts...>::named[sizeof...(Opts)];
+
+    /// A hash table of long names, built by the compiler. Each bucket has
+    /// the index of the first option whose name is in that bucket, and
+    /// each option the index of the next in the same bucket, or -1.
+    /// Options are chained in order, so the first with a name is found first
+    template <typename Buckets, typename Indices, typename... Opts> struct LongTable;
+
+    template <std::size_t... Buckets, std::size_t... Indices, typename... Opts>
+    struct LongTable<IndexSequence<Buckets...>, IndexSequence<Indices...>, Opts...> {
+      using Names = LongNames<Opts...>;
+
+      static constexpr std::int16_t buckets[sizeof...(Buckets)] = {
+        static_cast<std::int16_t>(Names::find(Buckets, 0, Names::count))... };
+
+      static constexpr std::int16_t next[sizeof...(Indices)] = {
+        static_cast<std::int16_t>(Names::find(Names::bucket(Names::hashes[Indices]),
+                                              Indices + 1, Names::count))... };
+    };
+
+    template <std::size_t... Buckets, std::size_t... Indices, typename... Opts>
+    constexpr std::int16_t LongTable<IndexSequence<Buckets...>, IndexSequence<Indices...>,
+                                     Opts...>::buckets[sizeof...(Buckets)];
+
+    template <std::size_t... Buckets, std::size_t... Indices, typename... Opts>
+    constexpr std::int16_t LongTable<IndexSequence<Buckets...>, IndexSequence<Indices...>,
+                                     Opts...>::next[sizeof...(Indices)];
+
+    /// A table from every char value to an option index, or -1
+    template <typename Sequence, typename... Opts> struct ShortTable;
+
+    template <std::size_t... Chars, typename... Opts>
+    struct ShortTable<IndexSequence<Chars...>, Opts...> {
+      static constexpr std::int16_t table[sizeof...(Chars)] = {
+        static_cast<std::int16_t>(
+          ShortNames<Opts...>::find(static_cast<char>(Chars), 0, sizeof...(Opts)))... };
+    };
+
+    template <std::size_t... Chars, typename... Opts>
+    constexpr std::int16_t ShortTable<IndexSequence<Chars...>, Opts...>::table[sizeof...(Chars)];
+  } // namespace detail
+
+  /// A set of options fixed at compile time
+  ///
+  /// Each option is a type with static constexpr members shortopt,
+  /// longopt and help. The lookup tables are constants generated by
+  /// the compiler, so there is no registration or heap allocation
+  /// before parsing. Short options are found with a single table load,
+  /// long options through a constant hash table of the names.
+  ///
+  /// Parsing is the same as Parser, and returns the same options_list.
+  ///
+  /// Example
+  /// -------
+  ///
+  /// struct Help {
+  ///   static constexpr char shortopt = 'h';
+  ///   static constexpr const char *longopt = "help";
+  ///   static constexpr const char *help = "print help message";
+  /// };
+  /// struct Verbose { ... };
+  ///
+  /// using Options = ArgOpts::Schema<Help, Verbose>;
+  ///
+  /// for (auto &opt : Options::parse(argc, argv)) {
+  ///   switch (opt.shortopt) {
+  ///     ...
+  ///   }
+  /// }
+  ///
+  template <typename... Opts>
+  class Schema {
+    static_assert(sizeof...(Opts) > 0, "Schema needs at least one option");
+
+  public:
+    using options_list = ArgOpts::options_list;
+
+    /// Looks for options in the given arguments. See Parser::parse
+    static options_list parse(int argc, char **argv,
+                              ValueStorage storage = ValueStorage::copy) {
+      return collectOptions(argc, argv, Schema(), storage);
+    }
+
+    /// Calls visit(const Option &) for each option found. See Parser::parse
+    template <typename Visitor>
+    static void parse(int argc, char **argv, Visitor &&visit) {
+      visitOptions(argc, argv, Schema(), std::forward<Visitor>(visit));
+    }
+
+    /// Returns a formatted string, listing the known options
+    static std::string printOptions() {
+      std::string result;
+
+      for (auto &it : options) {
+        result += usage(it.shortopt, it.longopt, it.help) + "\n";
+      }
+      return result;
+    }
+
+    /// Find the option with the given long name, or nullptr
+    static const OptionInfo *findLong(StringRef longopt) {
+      if (longopt.length() == 0) {
+        return nullptr;
+      }
+      using Names = detail::LongNames<Opts...>;
+      using Table = detail::LongTable<typename detail::MakeIndexSequence<Names::size>::type,
+                                      typename detail::MakeIndexSequence<Names::count>::type,
+                                      Opts...>;
+
+      const std::uint32_t hash = detail::hashBytes(longopt.data(), longopt.size());
+      for (int n = Table::buckets[Names::bucket(hash)]; n >= 0; n = Table::next[n]) {
+        if ((Names::hashes[n] == hash) && (longopt == options[n].longopt)) {
+          return &options[n];
         }
       }
-      return options_found;
+      return nullptr;
+    }
+
+    /// Find the option with the given short name, or nullptr
+    static const OptionInfo *findShort(char shortopt) {
+      return entry(detail::ShortTable<typename detail::MakeIndexSequence<256>::type,
+                   Opts...>::table[static_cast<unsigned char>(shortopt)]);
     }
 
+    /// The options, in the order given
+    static constexpr OptionInfo options[sizeof...(Opts)] = {
+      {Opts::shortopt, Opts::longopt, Opts::help}... };
+
   private:
-    std::list<Option> options; ///< The options known about from construction or add() calls
+    static const OptionInfo *entry(int n) {
+      if (n < 0) {
+        return nullptr;
+      }
+      return &options[n];
+    }
   };
 
+  template <typename... Opts>
+  constexpr OptionInfo Schema<Opts...>::options[sizeof...(Opts)];
+
 } // namespace ArgOpts;
@@ -0,0 +1,493 @@
+// Generates a header containing option lookup tables from a schema file
+//
+// Usage:
+//
+//    argopts_gen <schema file> <output header> [namespace]
+//
+// The namespace defaults to the schema file name without directory or
+// extension, and is placed inside the ArgOpts namespace.
+//
+// Schema format
+// -------------
+//
+// One option per line, with fields separated by whitespace:
+//
+//    <short> <long> <type> <help text>
+//
+// where <short> is a single character or '-' for none, <long> is the
+// long name or '-' for none, and <type> is "flag" for an option without
+// a value, or the C++ type of the value (e.g. int, double, string).
+// The help text is the rest of the line. Blank lines and lines starting
+// with '#' are ignored.
+//
+// Generated header
+// ----------------
+//
+// The header contains constant tables, so there is no registration
+// at startup. These are static members of Lookup, so the header can
+// be included in several source files:
+//  - options, an array of OptionInfo
+//  - a 256-entry table from short option character to option
+//  - a perfect hash of the long names, using the "hash and displace"
+//    method: the first hash of a name selects a bucket, and each bucket
+//    stores a seed for a second hash which places its names in distinct
+//    slots. Every lookup is two hashes and one comparison. There is one
+//    slot per name unless that fails, when slots are added until it works.
+//  - parse() and printOptions(), as for Parser
+//  - an Arguments struct with a typed member for each option, filled
+//    by parseArguments()
+
+#include "argopts.hxx"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+  struct SchemaOption {
+    char shortopt;
+    std::string longopt;
+    std::string type; ///< C++ type, or "flag"
+    std::string help;
+  };
+
+  /// Hash used for the long name tables. Must match the generated lookup
+  std::uint32_t seededHash(const std::string &name, std::uint32_t seed) {
+    return ArgOpts::detail::seededHash(name.data(), name.size(), seed);
+  }
+
+  /// The name of the Arguments member for an option
+  std::string memberName(const SchemaOption &option) {
+    if (option.longopt.empty()) {
+      return std::string("opt_") + option.shortopt;
+    }
+    std::string result = option.longopt;
+    for (char &c : result) {
+      if (!std::isalnum(static_cast<unsigned char>(c))) {
+        c = '_';
+      }
+    }
+    if (std::isdigit(static_cast<unsigned char>(result[0]))) {
+      result = "opt_" + result;
+    }
+    return result;
+  }
+
+  /// True if the name is a C++ keyword, up to C++20, or an alternative token
+  bool isKeyword(const std::string &name) {
+    static const std::set<std::string> keywords = {
+      "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool",
+      "break", "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class",
+      "compl", "concept", "const", "consteval", "constexpr", "constinit", "const_cast",
+      "continue", "co_await", "co_return", "co_yield", "decltype", "default", "delete",
+      "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern",
+      "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+      "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or",
+      "or_eq", "private", "protected", "public", "register", "reinterpret_cast",
+      "requires", "return", "short", "signed", "sizeof", "static", "static_assert",
+      "static_cast", "struct", "switch", "template", "this", "thread_local", "throw",
+      "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+      "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"};
+    return keywords.count(name) != 0;
+  }
+
+  /// True if the name can be used for a namespace or member
+  bool isIdentifier(const std::string &name) {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+      return false;
+    }
+    for (char c : name) {
+      if (!std::isalnum(static_cast<unsigned char>(c)) && (c != '_')) {
+        return false;
+      }
+    }
+    return !isKeyword(name);
+  }
+
+  /// The default namespace for a schema file: the file name without
+  /// directory or extension, made into an identifier
+  std::string namespaceName(const std::string &source) {
+    std::string name = source.substr(source.find_last_of('/') + 1);
+    name = name.substr(0, name.find_first_of('.'));
+    for (char &c : name) {
+      if (!std::isalnum(static_cast<unsigned char>(c))) {
+        c = '_';
+      }
+    }
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+      name = "opts_" + name;
+    }
+    if (isKeyword(name)) {
+      name += "_opts";
+    }
+    return name;
+  }
+
+  std::vector<SchemaOption> readSchema(std::istream &in, const std::string &filename) {
+    std::vector<SchemaOption> options;
+    // The Arguments members, and the option which each is for. The
+    // struct itself and its "unknown" member are reserved
+    std::map<std::string, std::string> members = {{"unknown", "the unknown options"},
+                                                  {"Arguments", "the struct name"}};
+    // Short names, and the option which each is for
+    std::map<char, std::string> shorts;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+      line_number++;
+      std::istringstream fields(line);
+      std::string shortname, longname, type;
+      if (!(fields >> shortname) || (shortname[0] == '#')) {
+        continue; // Blank or comment
+      }
+      if (!(fields >> longname >> type) || (shortname.length() != 1) ||
+          ((shortname == "-") && (longname == "-"))) {
+        throw std::invalid_argument(filename + ":" + std::to_string(line_number) +
+                                    ": expected <short> <long> <type> <help>");
+      }
+      std::string help;
+      std::getline(fields >> std::ws, help);
+
+      if (type == "string") {
+        type = "std::string";
+      }
+      options.push_back({shortname == "-" ? '\0' : shortname[0],
+                         longname == "-" ? "" : longname, type, help});
+
+      // The member must be a distinct identifier, which doesn't hide a type
+      const SchemaOption &option = options.back();
+      const std::string member = memberName(option);
+      const std::string location = filename + ":" + std::to_string(line_number) + ": ";
+      const std::string name = ArgOpts::usage(option.shortopt, option.longopt, "");
+      if ((option.shortopt != 0) && !shorts.insert({option.shortopt, name}).second) {
+        throw std::invalid_argument(location + "short option -" + option.shortopt + " for " +
+                                    name + " is already used by " + shorts[option.shortopt]);
+      }
+      if (isKeyword(member)) {
+        throw std::invalid_argument(location + "member name '" + member + "' for " + name +
+                                    " is a C++ keyword");
+      }
+      auto inserted = members.insert({member, name});
+      if (!inserted.second) {
+        throw std::invalid_argument(location + "member name '" + member + "' for " + name +
+                                    " is already used by " + inserted.first->second);
+      }
+    }
+    for (auto &option : options) {
+      if (members.count(option.type) != 0) {
+        throw std::invalid_argument(filename + ": type '" + option.type +
+                                    "' has the same name as the member for " +
+                                    members[option.type]);
+      }
+    }
+    return options;
+  }
+
+  /// Tries to place the names of each bucket into slot_count slots,
+  /// searching for a seed which puts them in distinct free slots.
+  /// Returns false if a bucket can't be placed within a limited number
+  /// of seeds, so that the caller can try again with more slots
+  bool placeBuckets(const std::vector<std::string> &names,
+                    const std::vector<std::vector<int>> &buckets,
+                    const std::vector<std::uint32_t> &order, std::uint32_t slot_count,
+                    std::vector<std::uint32_t> &seeds, std::vector<int> &slots) {
+    const std::uint32_t max_seed = 1u << 16;
+    seeds.assign(buckets.size(), 0);
+    slots.assign(slot_count, -1);
+
+    std::vector<std::uint32_t> placed;
+    for (std::uint32_t b : order) {
+      const std::vector<int> &bucket = buckets[b];
+      if (bucket.empty()) {
+        break;
+      }
+      std::uint32_t seed = 1;
+      for (; seed <= max_seed; seed++) {
+        placed.clear();
+        bool ok = true;
+        for (int n : bucket) {
+          std::uint32_t slot = seededHash(names[n], seed) % slot_count;
+          if ((slots[slot] != -1) ||
+              (std::find(placed.begin(), placed.end(), slot) != placed.end())) {
+            ok = false;
+            break;
+          }
+          placed.push_back(slot);
+        }
+        if (ok) {
+          break;
+        }
+      }
+      if (seed > max_seed) {
+        return false;
+      }
+      seeds[b] = seed;
+      for (std::size_t i = 0; i < bucket.size(); i++) {
+        slots[placed[i]] = bucket[i];
+      }
+    }
+    return true;
+  }
+
+  /// Builds a perfect hash of the given names, with one bucket per name.
+  /// The table has one slot per name if possible, otherwise slots are
+  /// added until every bucket can be placed
+  ///
+  /// @param[in] names   The names to hash, which must be distinct
+  /// @param[out] seeds  One seed per bucket, used for the second hash
+  /// @param[out] slots  Index into names for each slot, or -1
+  void perfectHash(const std::vector<std::string> &names,
+                   std::vector<std::uint32_t> &seeds, std::vector<int> &slots) {
+    // At least one bucket and slot, so the arrays are not empty
+    const std::uint32_t size = std::max<std::uint32_t>(static_cast<std::uint32_t>(names.size()), 1);
+
+    std::vector<std::vector<int>> buckets(size);
+    for (std::uint32_t n = 0; n < names.size(); n++) {
+      buckets[seededHash(names[n], 0) % size].push_back(n);
+    }
+    // Place the largest buckets first, while there are many free slots
+    std::vector<std::uint32_t> order(size);
+    for (std::uint32_t b = 0; b < size; b++) {
+      order[b] = b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+      });
+
+    for (std::uint32_t slot_count = size; ; slot_count += slot_count / 16 + 1) {
+      if (placeBuckets(names, buckets, order, slot_count, seeds, slots)) {
+        return;
+      }
+    }
+  }
+
+  /// Quote a string as a C++ string literal
+  std::string quote(const std::string &str) {
+    std::string result = "\"";
+    for (char c : str) {
+      if ((c == '"') || (c == '\\')) {
+        result += '\\';
+      }
+      result += c;
+    }
+    return result + "\"";
+  }
+
+  /// Quote a character as a C++ character literal
+  std::string quote(char c) {
+    if (c == 0) {
+      return "0";
+    }
+    if ((c == '\'') || (c == '\\')) {
+      return std::string("'\\") + c + "'";
+    }
+    return std::string("'") + c + "'";
+  }
+
+  /// A list of numbers, formatted with a fixed number per line
+  template <typename T>
+  std::string numberList(const std::vector<T> &values, const std::string &indent) {
+    std::ostringstream out;
+    for (std::size_t n = 0; n < values.size(); n++) {
+      out << ((n % 16 == 0) ? "\n" + indent : " ") << values[n] << ",";
+    }
+    return out.str();
+  }
+
+  void writeHeader(std::ostream &out, const std::vector<SchemaOption> &options,
+                   const std::string &source, const std::string &name) {
+    // Long names, with the index of the option they refer to
+    std::vector<std::string> long_names;
+    std::vector<int> long_options;
+    std::set<std::string> seen;
+    for (std::size_t n = 0; n < options.size(); n++) {
+      if (options[n].longopt.empty()) {
+        continue;
+      }
+      if (!seen.insert(options[n].longopt).second) {
+        throw std::invalid_argument("duplicate long option '" + options[n].longopt + "'");
+      }
+      long_names.push_back(options[n].longopt);
+      long_options.push_back(static_cast<int>(n));
+    }
+    std::vector<std::uint32_t> seeds;
+    std::vector<int> slots;
+    perfectHash(long_names, seeds, slots);
+    for (int &slot : slots) {
+      if (slot >= 0) {
+        slot = long_options[slot];
+      }
+    }
+
+    // Each short name must identify one option, as index() looks it up
+    std::vector<int> short_table(256, -1);
+    for (std::size_t n = 0; n < options.size(); n++) {
+      if (options[n].shortopt != 0) {
+        int &slot = short_table[static_cast<unsigned char>(options[n].shortopt)];
+        if (slot >= 0) {
+          throw std::invalid_argument(std::string("duplicate short option '") +
+                                      options[n].shortopt + "'");
+        }
+        slot = static_cast<int>(n);
+      }
+    }
+
+    const std::string indent = "    ";
+    const std::string member = indent + "  ";
+    out << "// Generated by argopts_gen from " << source << "\n"
+        << "// Do not edit: changes will be overwritten\n\n"
+        << "#pragma once\n\n"
+        << "#include \"argopts.hxx\"\n\n"
+        << "namespace ArgOpts {\n"
+        << "  namespace " << name << " {\n\n"
+        << indent << "/// Option tables and lookup, for use with scanArguments and collectOptions.\n"
+        << indent << "/// A template only so that the tables, as static members, can be defined\n"
+        << indent << "/// in this header and included in several source files. Use Lookup\n"
+        << indent << "template <typename Unused = void>\n"
+        << indent << "struct BasicLookup {\n"
+        << member << "/// The options, in the order given in the schema\n"
+        << member << "static constexpr OptionInfo options[" << options.size() << "] = {\n";
+    for (auto &option : options) {
+      out << member << "  {" << quote(option.shortopt) << ", " << quote(option.longopt)
+          << ", " << quote(option.help) << "},\n";
+    }
+    out << member << "};\n\n"
+        << member << "/// Short option character to index into options, or -1\n"
+        << member << "static constexpr std::int16_t short_table[256] = {"
+        << numberList(short_table, member + "  ") << "\n" << member << "};\n\n"
+        << member << "/// Perfect hash of the long names. The first hash selects\n"
+        << member << "/// a seed for the second hash, which gives the slot\n"
+        << member << "static constexpr std::uint32_t long_seeds[" << seeds.size() << "] = {"
+        << numberList(seeds, member + "  ") << "\n" << member << "};\n\n"
+        << member << "/// Index into options for each slot, or -1\n"
+        << member << "static constexpr std::int16_t long_slots[" << slots.size() << "] = {"
+        << numberList(slots, member + "  ") << "\n" << member << "};\n\n"
+        << member << "/// Index into options of the given short option, or -1\n"
+        << member << "static int shortIndex(char shortopt) {\n"
+        << member << "  return short_table[static_cast<unsigned char>(shortopt)];\n"
+        << member << "}\n\n"
+        << member << "/// Index into options of the given long option, or -1\n"
+        << member << "static int longIndex(StringRef longopt) {\n"
+        << member << "  const int n = long_slots[detail::perfectHashSlot(longopt.data(), longopt.size(),\n"
+        << member << "                                                   long_seeds, "
+        << seeds.size() << ", " << slots.size() << ")];\n"
+        << member << "  if ((n < 0) || (longopt.length() == 0) || (longopt != options[n].longopt)) {\n"
+        << member << "    return -1;\n"
+        << member << "  }\n"
+        << member << "  return n;\n"
+        << member << "}\n\n"
+        << member << "/// Index into options of a parsed Option, or -1\n"
+        << member << "static int index(const Option &option) {\n"
+        << member << "  return (option.shortopt != 0) ? shortIndex(option.shortopt) : longIndex(option.longopt);\n"
+        << member << "}\n\n"
+        << member << "static const OptionInfo *findShort(char shortopt) {\n"
+        << member << "  const int n = shortIndex(shortopt);\n"
+        << member << "  return (n < 0) ? nullptr : &options[n];\n"
+        << member << "}\n\n"
+        << member << "static const OptionInfo *findLong(StringRef longopt) {\n"
+        << member << "  const int n = longIndex(longopt);\n"
+        << member << "  return (n < 0) ? nullptr : &options[n];\n"
+        << member << "}\n"
+        << indent << "};\n\n"
+        << indent << "template <typename Unused>\n"
+        << indent << "constexpr OptionInfo BasicLookup<Unused>::options[" << options.size() << "];\n"
+        << indent << "template <typename Unused>\n"
+        << indent << "constexpr std::int16_t BasicLookup<Unused>::short_table[256];\n"
+        << indent << "template <typename Unused>\n"
+        << indent << "constexpr std::uint32_t BasicLookup<Unused>::long_seeds[" << seeds.size() << "];\n"
+        << indent << "template <typename Unused>\n"
+        << indent << "constexpr std::int16_t BasicLookup<Unused>::long_slots[" << slots.size() << "];\n\n"
+        << indent << "using Lookup = BasicLookup<>;\n\n"
+        << indent << "/// Looks for options in the given arguments. See Parser::parse\n"
+        << indent << "inline options_list parse(int argc, char **argv,\n"
+        << indent << "                          ValueStorage storage = ValueStorage::copy) {\n"
+        << indent << "  return collectOptions(argc, argv, Lookup(), storage);\n"
+        << indent << "}\n\n"
+        << indent << "/// Returns a formatted string, listing the known options\n"
+        << indent << "inline std::string printOptions() {\n"
+        << indent << "  std::string result;\n"
+        << indent << "  for (auto &it : Lookup::options) {\n"
+        << indent << "    result += usage(it.shortopt, it.longopt, it.help) + \"\\n\";\n"
+        << indent << "  }\n"
+        << indent << "  return result;\n"
+        << indent << "}\n\n"
+        << indent << "/// The value of each option. Flags are true if given,\n"
+        << indent << "/// and other options hold the last value given\n"
+        << indent << "struct Arguments {\n";
+    for (auto &option : options) {
+      out << indent << "  " << (option.type == "flag" ? "bool" : option.type) << " "
+          << memberName(option) << (option.type == "flag" ? " = false;" : " = {};")
+          << " ///< " << ArgOpts::usage(option.shortopt, option.longopt, "") << "\n";
+    }
+    out << indent << "  options_list unknown; ///< Options not in the schema\n"
+        << indent << "};\n\n"
+        << indent << "/// Parse the arguments, converting values to the types in the schema\n"
+        << indent << "/// Throws std::invalid_argument if a value can't be converted\n"
+        << indent << "inline Arguments parseArguments(int argc, char **argv) {\n"
+        << indent << "  Arguments result;\n"
+        << indent << "  for (auto &opt : parse(argc, argv)) {\n"
+        << indent << "    switch (Lookup::index(opt)) {\n";
+    for (std::size_t n = 0; n < options.size(); n++) {
+      out << indent << "    case " << n << ": ";
+      if (options[n].type == "flag") {
+        out << "result." << memberName(options[n]) << " = true; break;\n";
+      } else {
+        out << "result." << memberName(options[n]) << " = opt.arg.get<"
+            << options[n].type << ">(); break;\n";
+      }
+    }
+    out << indent << "    default: result.unknown.push_back(opt);\n"
+        << indent << "    }\n"
+        << indent << "  }\n"
+        << indent << "  return result;\n"
+        << indent << "}\n\n"
+        << "  } // namespace " << name << "\n"
+        << "} // namespace ArgOpts\n";
+  }
+}
+
+// Defined when the generator's functions are included in the tests
+#ifndef ARGOPTS_GEN_NO_MAIN
+int main(int argc, char **argv) {
+  if ((argc < 3) || (argc > 4)) {
+    std::cerr << "Usage: " << argv[0] << " <schema file> <output header> [namespace]\n";
+    return 1;
+  }
+  const std::string source = argv[1];
+
+  const std::string name = (argc == 4) ? argv[3] : namespaceName(source);
+
+  try {
+    if (!isIdentifier(name)) {
+      throw std::invalid_argument("namespace '" + name + "' is not a valid C++ identifier");
+    }
+    std::ifstream in(source);
+    if (!in) {
+      throw std::invalid_argument("could not open " + source);
+    }
+    std::vector<SchemaOption> options = readSchema(in, source);
+    if (options.empty()) {
+      throw std::invalid_argument(source + ": no options");
+    }
+    if (options.size() > 32767) {
+      throw std::invalid_argument(source + ": too many options for 16-bit tables");
+    }
+
+    std::ofstream out(argv[2]);
+    writeHeader(out, options, source, name);
+    if (!out) {
+      throw std::runtime_error(std::string("could not write ") + argv[2]);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << argv[0] << ": " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+#endif // ARGOPTS_GEN_NO_MAIN
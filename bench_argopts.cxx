@@ -0,0 +1,603 @@
+// Benchmarks for the ArgOpts parser
+//
+// Build and run with "make bench". Each benchmark prints a table
+// of timings, so that the scaling with problem size can be seen.
+
+#include "argopts.hxx"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Number of calls to operator new, to count allocations
+static std::size_t allocation_count = 0;
+
+// Neither operator new nor delete is inlined, since GCC would then
+// warn that memory from malloc is released with operator delete,
+// or memory from operator new with free
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void *operator new(std::size_t size) {
+  allocation_count++;
+  if (void *ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+  /// Results are stored here so the compiler can't remove the calculation
+  volatile double result_sink = 0;
+
+  using Clock = std::chrono::steady_clock;
+
+  /// Holds a set of argument strings, and provides
+  /// an argv-style array pointing to them
+  struct ArgList {
+    explicit ArgList(const std::vector<std::string> &args) : args(args) {
+      for (auto &arg : this->args) {
+        argv.push_back(&arg[0]);
+      }
+    }
+    int argc() const { return static_cast<int>(argv.size()); }
+    char **data() { return argv.data(); }
+  private:
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+  };
+
+  /// Time how long a function takes to run, returning
+  /// the average time per call in nanoseconds
+  template <typename Function>
+  double timeCall(Function &&function, int repeats) {
+    auto start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+      function();
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / repeats;
+  }
+
+  /// Count the average number of allocations made by a function
+  template <typename Function>
+  double countAllocations(Function &&function, int repeats) {
+    std::size_t start = allocation_count;
+    for (int r = 0; r < repeats; r++) {
+      function();
+    }
+    return static_cast<double>(allocation_count - start) / repeats;
+  }
+
+  /// Grouped short options with a large value. The cost should be
+  /// linear in the number of options plus the size of the value,
+  /// since the options share one copy of the value.
+  void groupedLargeValue() {
+    const int repeats = 20;
+
+    std::cout << "Grouped short options with a large value\n";
+    std::cout << std::setw(12) << "characters" << std::setw(12) << "value"
+              << std::setw(16) << "ns/parse" << std::setw(16) << "allocs/parse"
+              << "\n";
+
+    for (std::size_t value_size : {1000, 1000000}) {
+      for (int nchars = 10; nchars <= 10000; nchars *= 10) {
+        std::string group = "-";
+        for (int n = 0; n < nchars; n++) {
+          group += static_cast<char>('a' + n % 26);
+        }
+        ArgList argv({"benchmark", group, std::string(value_size, 'v')});
+
+        const ArgOpts::Parser parser;
+        std::size_t found = 0;
+        auto parse = [&]() {
+          found += parser.parse(argv.argc(), argv.data()).size();
+        };
+        double ns = timeCall(parse, repeats);
+        double allocs = countAllocations(parse, repeats);
+
+        std::cout << std::setw(12) << nchars << std::setw(12) << value_size
+                  << std::setw(16) << std::fixed << std::setprecision(0) << ns
+                  << std::setw(16) << std::setprecision(1) << allocs << "\n";
+      }
+    }
+    std::cout << "\n";
+  }
+
+  /// Conversion through a stringstream, as StringStore::get used
+  /// to do for all types. Used as a reference for conversions.
+  template <typename T>
+  T streamConvert(const std::string &value) {
+    T t;
+    std::stringstream ss(value);
+    ss >> t;
+    if (ss.fail()) {
+      throw std::invalid_argument("could not convert " + value);
+    }
+    std::string remainder;
+    std::getline(ss, remainder);
+    for (const char &ch : remainder) {
+      if (!std::isspace(static_cast<unsigned char>(ch))) {
+        throw std::invalid_argument("could not convert " + value);
+      }
+    }
+    return t;
+  }
+
+  /// Compare conversions per second using StringStore::get
+  /// against a reference, by default a stringstream
+  template <typename T, typename Reference>
+  void conversionRate(const std::string &type_name, const std::vector<std::string> &values,
+                      Reference reference) {
+    const int repeats = 20;
+
+    T sum = 0;
+    double get_ns = timeCall([&]() {
+        for (auto &value : values) {
+          sum += ArgOpts::StringStore::borrow(value).get<T>();
+        }
+      }, repeats) / values.size();
+
+    double stream_ns = timeCall([&]() {
+        for (auto &value : values) {
+          sum += reference(value);
+        }
+      }, repeats) / values.size();
+
+    std::cout << std::setw(12) << type_name << std::setw(16) << std::fixed
+              << std::setprecision(1) << 1e3 / get_ns << std::setw(16)
+              << 1e3 / stream_ns << std::setw(12) << stream_ns / get_ns << "\n";
+    result_sink = static_cast<double>(sum);
+  }
+
+  template <typename T>
+  void conversionRate(const std::string &type_name, const std::vector<std::string> &values) {
+    conversionRate<T>(type_name, values, streamConvert<T>);
+  }
+
+  /// Conversion of strings to numbers
+  void conversions() {
+    std::vector<std::string> integers, floats, hex;
+    for (int n = 0; n < 10000; n++) {
+      integers.push_back(std::to_string((n * 7919) % 1000000 - 500000));
+      floats.push_back(std::to_string(n * 0.37) + "e-3");
+      std::stringstream ss;
+      ss << "0x" << std::hex << (n * 7919) % 1000000;
+      hex.push_back(ss.str());
+    }
+
+    std::cout << "Conversions, in millions per second\n";
+    std::cout << std::setw(12) << "type" << std::setw(16) << "get<T>"
+              << std::setw(16) << "stringstream" << std::setw(12) << "speedup" << "\n";
+    conversionRate<int>("int", integers);
+    conversionRate<long long>("long long", integers);
+    conversionRate<double>("double", floats);
+    conversionRate<int>("hex int", hex, [](const std::string &value) {
+        int t = 0;
+        std::stringstream ss(value);
+        ss >> std::hex >> t;
+        return t;
+      });
+    conversionRate<long long>("strtoll", integers, [](const std::string &value) {
+        return std::strtoll(value.c_str(), nullptr, 10);
+      });
+    std::cout << "\n";
+
+    // Reading the same value repeatedly, as in a loop
+    const int reads = 1000000;
+    ArgOpts::StringStore store("123456");
+    long long sum = 0;
+    double get_ns = timeCall([&]() { sum += store.get<int>(); }, reads);
+    ArgOpts::Converted<int> converted(store);
+    double converted_ns = timeCall([&]() { sum += converted; }, reads);
+    double stream_ns = timeCall([&]() { sum += streamConvert<int>("123456"); }, reads);
+    result_sink = static_cast<double>(sum);
+
+    std::cout << "Repeated reads of one value, ns per read\n";
+    std::cout << std::setw(12) << "get<int>" << std::setw(16) << std::setprecision(1)
+              << get_ns << "\n";
+    std::cout << std::setw(12) << "Converted" << std::setw(16) << converted_ns << "\n";
+    std::cout << std::setw(12) << "stream" << std::setw(16) << stream_ns << "\n\n";
+
+    // Constructing a StringStore from a value, e.g. for defaults
+    std::size_t length = 0;
+    std::size_t before = allocation_count;
+    double int_ns = timeCall([&]() { length += ArgOpts::StringStore(-123456).str().size(); },
+                             reads);
+    double int_allocations = double(allocation_count - before) / reads;
+    before = allocation_count;
+    double double_ns = timeCall([&]() { length += ArgOpts::StringStore(3.14159).str().size(); },
+                                reads);
+    double double_allocations = double(allocation_count - before) / reads;
+    result_sink = static_cast<double>(length);
+
+    std::cout << "Construction from a value\n";
+    std::cout << std::setw(12) << "type" << std::setw(16) << "ns" << std::setw(16)
+              << "allocations" << "\n";
+    std::cout << std::setw(12) << "int" << std::setw(16) << int_ns
+              << std::setw(16) << int_allocations << "\n";
+    std::cout << std::setw(12) << "double" << std::setw(16) << double_ns
+              << std::setw(16) << double_allocations << "\n\n";
+
+    // Probing whether a value is a number, when it usually isn't
+    const int probes = 100000;
+    ArgOpts::StringStore word("not-a-number");
+    int numbers = 0;
+    double catch_ns = timeCall([&]() {
+        try {
+          numbers += word.get<int>();
+        } catch (const std::invalid_argument &) {
+        }
+      }, probes);
+    double try_ns = timeCall([&]() { numbers += word.tryGet<int>().valueOr(0); }, probes);
+    result_sink = numbers;
+
+    std::cout << "Failed conversion, ns per probe\n";
+    std::cout << std::setw(12) << "try/catch" << std::setw(16) << catch_ns << "\n";
+    std::cout << std::setw(12) << "tryGet" << std::setw(16) << try_ns << "\n\n";
+
+    // Values with units, converted each time rather than cached
+    std::uint64_t total = 0;
+    double size_ns = timeCall([&]() {
+        total += ArgOpts::StringStore::borrow("512MiB").get<ArgOpts::ByteSize>();
+      }, probes);
+    double duration_ns = timeCall([&]() {
+        total += ArgOpts::StringStore::borrow("1.5s").get<std::chrono::milliseconds>().count();
+      }, probes);
+    result_sink = static_cast<double>(total);
+
+    std::cout << "Values with units, ns per conversion\n";
+    std::cout << std::setw(12) << "size" << std::setw(16) << size_ns << "\n";
+    std::cout << std::setw(12) << "duration" << std::setw(16) << duration_ns << "\n\n";
+  }
+
+  /// Conversion of a long list of values, as from a response file
+  void listConversion() {
+    const std::size_t count = 200000;
+    std::string list;
+    for (std::size_t n = 0; n < count; n++) {
+      if (n != 0) {
+        list += ',';
+      }
+      list += std::to_string(n * 0.37);
+    }
+    const ArgOpts::StringStore store(list);
+
+    const int repeats = 5;
+    double total = 0;
+    double get_ms = timeCall([&]() {
+        total += store.getList<double>().back();
+      }, repeats) / 1e6;
+
+    // Splitting with getline and converting each element with a stream
+    double stream_ms = timeCall([&]() {
+        std::vector<double> values;
+        std::stringstream ss(list);
+        std::string element;
+        while (std::getline(ss, element, ',')) {
+          values.push_back(streamConvert<double>(element));
+        }
+        total += values.back();
+      }, repeats) / 1e6;
+    result_sink = total;
+
+    std::cout << "List of " << count << " doubles, ms per conversion\n";
+    std::cout << std::setw(12) << "getList" << std::setw(16) << get_ms << "\n";
+    std::cout << std::setw(12) << "stream" << std::setw(16) << stream_ms << "\n\n";
+  }
+
+  /// Range expressions, compared with expanding them into a vector
+  void rangeConversion() {
+    const std::string ranges = "0-1023,2048,4000-4095,8192-1048575";
+    const ArgOpts::StringStore store(ranges);
+
+    const int repeats = 1000;
+    unsigned long long total = 0;
+    double set_ns = timeCall([&]() {
+        total += store.get<ArgOpts::IntervalSet>().count();
+      }, repeats);
+
+    double vector_ns = timeCall([&]() {
+        std::vector<int> values;
+        for (auto &element : store.getList<std::string>()) {
+          std::size_t dash = element.find('-');
+          int first = std::stoi(element.substr(0, dash));
+          int last = (dash == std::string::npos) ? first : std::stoi(element.substr(dash + 1));
+          for (int n = first; n <= last; n++) {
+            values.push_back(n);
+          }
+        }
+        total += values.size();
+      }, repeats);
+
+    const ArgOpts::IntervalSet set = store.get<ArgOpts::IntervalSet>();
+    int found = 0;
+    double contains_ns = timeCall([&]() { found += set.contains(found % 2000000); }, 1000000);
+    result_sink = static_cast<double>(total + found);
+
+    std::cout << "Range \"" << ranges << "\" (" << set.count() << " values)\n";
+    std::cout << std::setw(12) << "IntervalSet" << std::setw(16) << set_ns << " ns, "
+              << set.intervals().size() * sizeof(ArgOpts::IntervalSet::Interval) << " bytes\n";
+    std::cout << std::setw(12) << "vector" << std::setw(16) << vector_ns << " ns, "
+              << set.count() * sizeof(int) << " bytes\n";
+    std::cout << std::setw(12) << "contains" << std::setw(16) << contains_ns << " ns\n\n";
+  }
+
+  /// Reading a large "@file" value, compared with reading it into a string
+  void fileContents() {
+    const char *path = "bench_contents.tmp";
+    const std::size_t size = 16 << 20;
+    {
+      std::ofstream out(path, std::ios::binary);
+      std::string line(63, 'x');
+      line += '\n';
+      for (std::size_t n = 0; n < size / line.size(); n++) {
+        out << line;
+      }
+    }
+    const ArgOpts::StringStore value = std::string("@") + path;
+
+    const int repeats = 20;
+    std::size_t total = 0;
+    double contents_ms = timeCall([&]() {
+        total += value.contents().view().size();
+      }, repeats) / 1e6;
+    double read_ms = timeCall([&]() {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        total += ss.str().size();
+      }, repeats) / 1e6;
+    result_sink = static_cast<double>(total);
+    std::remove(path);
+
+    std::cout << "File value of " << (size >> 20) << " MiB, ms per read\n";
+    std::cout << std::setw(12) << "contents" << std::setw(16) << contents_ms << "\n";
+    std::cout << std::setw(12) << "ifstream" << std::setw(16) << read_ms << "\n\n";
+  }
+
+  /// A typical command line, with a mixture of options and values
+  std::vector<std::string> typicalArguments() {
+    return {"benchmark", "--input=/path/to/some/input/file.dat", "-v",
+            "--output", "/path/to/the/output/directory", "-n", "1024",
+            "--tolerance=1e-8", "-xyz", "--name", "a-fairly-long-run-name-here",
+            "--threads=16", "positional", "-q"};
+  }
+
+  /// Time and count allocations for a typical command line
+  void typicalParse() {
+    const int repeats = 10000;
+
+    ArgOpts::Parser parser = { {'i', "input", "[FILE] input file"},
+                               {'o', "output", "[DIR] output directory"},
+                               {'n', "number", "[N] number of things"},
+                               {'t', "tolerance", "[TOL] tolerance"},
+                               {0, "name", "[NAME] name of the run"},
+                               {0, "threads", "[N] number of threads"},
+                               {'v', "verbose", "print more"},
+                               {'q', "quiet", "print less"} };
+    ArgList argv(typicalArguments());
+
+    std::cout << "Typical command line: " << argv.argc() << " arguments\n";
+    std::cout << std::setw(12) << "mode" << std::setw(16) << "ns/parse"
+              << std::setw(16) << "allocs/parse" << "\n";
+
+    for (auto storage : {ArgOpts::ValueStorage::copy, ArgOpts::ValueStorage::borrow}) {
+      std::size_t found = 0;
+      auto parse = [&]() {
+        found += parser.parse(argv.argc(), argv.data(), storage).size();
+      };
+      double ns = timeCall(parse, repeats);
+      double allocs = countAllocations(parse, repeats);
+
+      std::cout << std::setw(12)
+                << (storage == ArgOpts::ValueStorage::copy ? "copy" : "borrow")
+                << std::setw(16) << std::fixed << std::setprecision(0) << ns
+                << std::setw(16) << std::setprecision(1) << allocs << "\n";
+    }
+
+    ArgOpts::ParseSession session;
+    std::size_t found = 0;
+    auto parse = [&]() {
+      found += session.parse(argv.argc(), argv.data(), parser).size();
+    };
+    double ns = timeCall(parse, repeats);
+    double allocs = countAllocations(parse, repeats);
+
+    std::cout << std::setw(12) << "session" << std::setw(16) << std::fixed
+              << std::setprecision(0) << ns << std::setw(16)
+              << std::setprecision(1) << allocs << "\n";
+
+    // Each option passed to a callback, rather than collected
+    auto visit = [&]() {
+      parser.parse(argv.argc(), argv.data(), [&](const ArgOpts::Option &opt) {
+        found += opt.arg.view().size();
+      });
+    };
+    ns = timeCall(visit, repeats);
+    allocs = countAllocations(visit, repeats);
+
+    std::cout << std::setw(12) << "visit" << std::setw(16) << std::fixed
+              << std::setprecision(0) << ns << std::setw(16)
+              << std::setprecision(1) << allocs << "\n";
+
+    // The same options with declared arities, so that flags
+    // have no value and values are not scanned as options
+    const ArgOpts::Arity flag = ArgOpts::Arity::flag, value = ArgOpts::Arity::required;
+    ArgOpts::Parser declared = { {'i', "input", "[FILE] input file", value},
+                                 {'o', "output", "[DIR] output directory", value},
+                                 {'n', "number", "[N] number of things", value},
+                                 {'t', "tolerance", "[TOL] tolerance", value},
+                                 {0, "name", "[NAME] name of the run", value},
+                                 {0, "threads", "[N] number of threads", value},
+                                 {'v', "verbose", "print more", flag},
+                                 {'q', "quiet", "print less", flag} };
+    auto parse_declared = [&]() {
+      found += declared.parse(argv.argc(), argv.data()).size();
+    };
+    ns = timeCall(parse_declared, repeats);
+    allocs = countAllocations(parse_declared, repeats);
+
+    std::cout << std::setw(12) << "arity" << std::setw(16) << std::fixed
+              << std::setprecision(0) << ns << std::setw(16)
+              << std::setprecision(1) << allocs << "\n";
+
+    // Values converted into variables during the scan, rather than
+    // returned in a list and converted afterwards
+    std::string input, output, name;
+    int number = 0, threads = 0;
+    double tolerance = 0.0;
+    bool verbose = false, quiet = false;
+    ArgOpts::Parser bound;
+    bound.bind('i', "input", &input, "[FILE] input file");
+    bound.bind('o', "output", &output, "[DIR] output directory");
+    bound.bind('n', "number", &number, "[N] number of things");
+    bound.bind('t', "tolerance", &tolerance, "[TOL] tolerance");
+    bound.bind(0, "name", &name, "[NAME] name of the run");
+    bound.bind(0, "threads", &threads, "[N] number of threads");
+    bound.bindFlag('v', "verbose", &verbose, "print more");
+    bound.bindFlag('q', "quiet", &quiet, "print less");
+    auto parse_bound = [&]() {
+      found += bound.parse(argv.argc(), argv.data()).size();
+    };
+    // The same conversions, from the list returned by a declared parser
+    auto parse_convert = [&]() {
+      for (auto &opt : declared.parse(argv.argc(), argv.data())) {
+        switch (opt.shortopt) {
+        case 'i': input = opt.arg.str(); break;
+        case 'o': output = opt.arg.str(); break;
+        case 'n': number = opt.arg; break;
+        case 't': tolerance = opt.arg; break;
+        case 'v': verbose = true; break;
+        case 'q': quiet = true; break;
+        case 0:
+          if (opt.longopt == "name") {
+            name = opt.arg.str();
+          } else if (opt.longopt == "threads") {
+            threads = opt.arg;
+          }
+          break;
+        default: found++;
+        }
+      }
+    };
+
+    ns = timeCall(parse_convert, repeats);
+    allocs = countAllocations(parse_convert, repeats);
+    std::cout << std::setw(12) << "convert" << std::setw(16) << std::fixed
+              << std::setprecision(0) << ns << std::setw(16)
+              << std::setprecision(1) << allocs << "\n";
+
+    ns = timeCall(parse_bound, repeats);
+    allocs = countAllocations(parse_bound, repeats);
+    std::cout << std::setw(12) << "bound" << std::setw(16) << std::fixed
+              << std::setprecision(0) << ns << std::setw(16)
+              << std::setprecision(1) << allocs << "\n";
+    std::cout << "\n";
+  }
+
+  /// Parse a fixed number of long options, while the number of
+  /// options registered with the parser increases.
+  void longOptionScaling() {
+    const int nargs = 100; // Long options on the command line
+    const int repeats = 200;
+
+    std::cout << "Long option lookup: " << nargs << " arguments\n";
+    std::cout << std::setw(12) << "registered" << std::setw(16) << "ns/parse"
+              << std::setw(16) << "ns/argument" << std::setw(16) << "frozen ns/arg"
+              << "\n";
+
+    for (int noptions = 10; noptions <= 100000; noptions *= 10) {
+      ArgOpts::Parser parser;
+      for (int n = 0; n < noptions; n++) {
+        parser.add(0, "option" + std::to_string(n), "help text");
+      }
+
+      // Spread the arguments over the registered options,
+      // ending with the last one added
+      std::vector<std::string> args = {"benchmark"};
+      for (int n = 0; n < nargs; n++) {
+        args.push_back("--option" + std::to_string(noptions - 1 - (n * 7919) % noptions));
+      }
+      ArgList argv(args);
+
+      std::size_t found = 0;
+      double ns = timeCall([&]() {
+          found += parser.parse(argv.argc(), argv.data()).size();
+        }, repeats);
+
+      const ArgOpts::CompiledParser compiled = parser.freeze();
+      double frozen_ns = timeCall([&]() {
+          found += compiled.parse(argv.argc(), argv.data()).size();
+        }, repeats);
+
+      std::cout << std::setw(12) << noptions << std::setw(16) << std::fixed
+                << std::setprecision(0) << ns << std::setw(16)
+                << std::setprecision(1) << ns / nargs << std::setw(16)
+                << frozen_ns / nargs << "\n";
+    }
+    std::cout << "\n";
+  }
+
+  /// Parse a single argument containing a run of grouped
+  /// short flags, as the length of the run increases
+  void groupedShortScaling() {
+    const int repeats = 200;
+    const std::string flags = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    ArgOpts::Parser parser;
+    for (char c : flags) {
+      parser.add(c, "", "help text");
+    }
+
+    std::cout << "Grouped short options: " << flags.size() << " registered\n";
+    std::cout << std::setw(12) << "characters" << std::setw(16) << "ns/parse"
+              << std::setw(16) << "ns/character" << "\n";
+
+    for (int nchars = 10; nchars <= 10000; nchars *= 10) {
+      std::string group = "-";
+      for (int n = 0; n < nchars; n++) {
+        // The last registered flags are the slowest to find in a list
+        group += flags[flags.size() - 1 - n % 8];
+      }
+      ArgList argv({"benchmark", group});
+
+      std::size_t found = 0;
+      double ns = timeCall([&]() {
+          found += parser.parse(argv.argc(), argv.data()).size();
+        }, repeats);
+
+      std::cout << std::setw(12) << nchars << std::setw(16) << std::fixed
+                << std::setprecision(0) << ns << std::setw(16)
+                << std::setprecision(1) << ns / nchars << "\n";
+    }
+    std::cout << "\n";
+  }
+}
+
+int main() {
+  longOptionScaling();
+  groupedShortScaling();
+  groupedLargeValue();
+  typicalParse();
+  conversions();
+  listConversion();
+  rangeConversion();
+  fileContents();
+  return 0;
+}
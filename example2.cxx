@@ -3,46 +3,41 @@
 #include <iostream>
 
 int main(int argc, char **argv) {
-  ArgOpts::Parser args = { {'h', "help", "print help message"},
-                           {'v', "verbose", "print more"},
-                           {'f', "file", "[FILE] file name"},
-                           {'n', "number", "Some input integer"}};
-  
-  auto options = args.parse(argc, argv);
-  // first check for help
-  for (auto &opt: options) {
-    if (opt.shortopt == 'h') {
-      std::cout << "Usage:\n" << argv[0] << " [options]\n";
-      std::cout << "Options:\n" << args.printOptions() << "\n";
-      return 0;
-    }
+  bool help = false, verbose = false;
+  std::string filename;
+  // Holds the number, or why it could not be read, so parse() doesn't throw
+  ArgOpts::Expected<int> num = 0;
+
+  // Values are stored into these variables while parsing
+  ArgOpts::Parser args;
+  args.bindFlag('h', "help", &help, "print help message");
+  args.bindFlag('v', "verbose", &verbose, "print more");
+  args.bind('f', "file", &filename, "[FILE] file name");
+  args.bind('n', "number", &num, "Some input integer");
+
+  // Only options which are not bound are returned
+  auto unknown = args.parse(argc, argv);
+
+  if (help) {
+    std::cout << "Usage:\n" << argv[0] << " [options]\n";
+    std::cout << "Options:\n" << args.printOptions() << "\n";
+    return 0;
+  }
+  for (auto &opt: unknown) {
+    std::cout << "Unrecognised option " << opt.usage() << "\n";
+    return 1;
   }
-  // Check other options
-  for (auto &opt: options) {
-    switch (opt.shortopt) {
-    case 'v': {
-      std::cout << "Verbose\n";
-      break;
-    }
-    case 'f': {
-      // Option to set a file name
-      std::string filename = opt.arg;
-      std::cout << "Using file: '" << filename << "'\n";
-      break;
-    }
-    case 'n': {
-      int num = opt.arg; // Expect an int as the next argument
-      std::cout << "Got number: " << num << "\n";
-      break;
-    }
-    default: {
-      std::cout << "Unrecognised option " << opt.usage() << "\n";
-      return 1;
-    }
-    }
+  if (verbose) {
+    std::cout << "Verbose\n";
   }
-  
+  if (!filename.empty()) {
+    std::cout << "Using file: '" << filename << "'\n";
+  }
+  if (!num) {
+    std::cout << "Bad number: " << ArgOpts::describe(num.status()) << "\n";
+    return 1;
+  }
+  std::cout << "Got number: " << *num << "\n";
+
   return 0;
 }
- 
- 
@@ -0,0 +1,52 @@
+#include "argopts.hxx"
+
+#include <iostream>
+
+// Options known at compile time
+struct Help {
+  static constexpr char shortopt = 'h';
+  static constexpr const char *longopt = "help";
+  static constexpr const char *help = "print help message";
+};
+
+struct Verbose {
+  static constexpr char shortopt = 'v';
+  static constexpr const char *longopt = "verbose";
+  static constexpr const char *help = "print more";
+};
+
+struct Number {
+  static constexpr char shortopt = 'n';
+  static constexpr const char *longopt = "number";
+  static constexpr const char *help = "Some input integer";
+};
+
+using Options = ArgOpts::Schema<Help, Verbose, Number>;
+
+int main(int argc, char **argv) {
+
+  for (auto &opt : Options::parse(argc, argv)) {
+    switch (opt.shortopt) {
+    case 'h': {
+      std::cout << "Usage:\n" << argv[0] << " [options]\n";
+      std::cout << "Options:\n" << Options::printOptions() << "\n";
+      return 0;
+    }
+    case 'v': {
+      std::cout << "Verbose\n";
+      break;
+    }
+    case 'n': {
+      int num = opt.arg; // Expect an int as the next argument
+      std::cout << "Got number: " << num << "\n";
+      break;
+    }
+    default: {
+      std::cout << "Unrecognised option " << opt.usage() << "\n";
+      return 1;
+    }
+    }
+  }
+  
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include "example4_opts.hxx" // Generated from example4.opts
+
+#include <iostream>
+
+int main(int argc, char **argv) {
+  using namespace ArgOpts::example4;
+
+  Arguments args = parseArguments(argc, argv);
+
+  if (args.help) {
+    std::cout << "Usage:\n" << argv[0] << " [options]\n";
+    std::cout << "Options:\n" << printOptions() << "\n";
+    return 0;
+  }
+  if (args.verbose) {
+    std::cout << "Verbose\n";
+  }
+  if (!args.file.empty()) {
+    std::cout << "Using file: '" << args.file << "'\n";
+  }
+  std::cout << "Got number: " << args.number << "\n";
+  std::cout << "Got scale: " << args.scale << "\n";
+
+  for (auto &opt : args.unknown) {
+    std::cout << "Unrecognised option " << opt.usage() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -2,6 +2,8 @@
 
 #include "argopts.hxx"
 
+#include <fstream>
+
 TEST(StringStoreTests, StringTest) {
   ArgOpts::StringStore s("sometext42");
   std::string str = s;
@@ -50,6 +52,613 @@ TEST(StringStoreTests, ConstructDoubleTest) {
   ASSERT_DOUBLE_EQ(val, 32.726);
 }
 
+TEST(StringStoreTests, ConstructMatchesStream) {
+  auto streamed = [](double value) {
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+  };
+  for (double value : {32.726, -0.0001234, 1e100, 123456789.0, 0.5, 0.0}) {
+    EXPECT_EQ( ArgOpts::StringStore(value).str(), streamed(value) );
+  }
+  EXPECT_EQ( ArgOpts::StringStore(1.5f).str(), "1.5" );
+  EXPECT_EQ( ArgOpts::StringStore(0).str(), "0" );
+  EXPECT_EQ( ArgOpts::StringStore(-42).str(), "-42" );
+  EXPECT_EQ( ArgOpts::StringStore(std::numeric_limits<long long>::min()).str(),
+             "-9223372036854775808" );
+  EXPECT_EQ( ArgOpts::StringStore(std::numeric_limits<unsigned long long>::max()).str(),
+             "18446744073709551615" );
+  EXPECT_EQ( ArgOpts::StringStore(true).str(), "1" );
+  EXPECT_EQ( ArgOpts::StringStore('x').str(), "x" );
+}
+
+namespace {
+  struct Distance {
+    double metres;
+  };
+
+  std::istream &operator>>(std::istream &in, Distance &distance) {
+    return in >> distance.metres;
+  }
+
+  /// Error handler which records the value and type in a vector of strings
+  void recordError(const void *context, ArgOpts::StringRef value, ArgOpts::StringRef type_name,
+                   ArgOpts::ConversionStatus) {
+    auto *reported = static_cast<std::vector<std::string> *>(const_cast<void *>(context));
+    *reported = {value.str(), type_name.str()};
+  }
+}
+
+TEST(StringStoreTests, ConstructKeepsHandler) {
+  std::vector<std::string> reported;
+  ArgOpts::StringStore s(2.5, {recordError, &reported});
+  EXPECT_ANY_THROW( s.get<int>() );
+  ASSERT_EQ( reported.size(), 2 );
+  EXPECT_EQ( reported[0], "2.5" );
+}
+
+TEST(StringStoreTests, HandlerIsSmall) {
+  EXPECT_EQ( sizeof(ArgOpts::StringStore::ErrorHandler), 2 * sizeof(void *) );
+}
+
+TEST(StringStoreTests, CopyAndMove) {
+  const std::string large(3 * ArgOpts::StringStore::small_size, 'x');
+  ArgOpts::StringStore small("small"), shared(large);
+  ArgOpts::StringStore borrowed = ArgOpts::StringStore::borrow("borrowed");
+
+  // Copies of a small string have their own buffer
+  ArgOpts::StringStore copy = small;
+  small = shared;
+  EXPECT_EQ( copy.str(), "small" );
+  EXPECT_NE( copy.view().data(), small.view().data() );
+  // Copies of a large string share it
+  EXPECT_EQ( small.view().data(), shared.view().data() );
+
+  ArgOpts::StringStore moved = std::move(copy);
+  EXPECT_EQ( moved.str(), "small" );
+  moved = std::move(shared);
+  EXPECT_EQ( moved.str(), large );
+  moved = borrowed;
+  EXPECT_EQ( moved.view().data(), borrowed.view().data() );
+  moved = moved;
+  EXPECT_EQ( moved.str(), "borrowed" );
+  EXPECT_EQ( small.str(), large );
+}
+
+TEST(StringStoreTests, TypeNames) {
+  EXPECT_EQ( ArgOpts::TypeName<int>::get(), "int" );
+  EXPECT_EQ( ArgOpts::TypeName<unsigned long long>::get(), "unsigned long long" );
+  EXPECT_EQ( ArgOpts::TypeName<double>::get(), "double" );
+  EXPECT_EQ( ArgOpts::TypeName<std::string>::get(), "string" );
+  // Other types use the compiler's name
+  EXPECT_NE( ArgOpts::TypeName<Distance>::get().str().find("Distance"), std::string::npos );
+}
+
+TEST(StringStoreTests, ErrorTypeName) {
+  std::vector<std::string> reported;
+  ArgOpts::StringStore::ErrorHandler handler(recordError, &reported);
+  EXPECT_ANY_THROW( ArgOpts::StringStore("x", handler).get<long>() );
+  EXPECT_EQ( reported[1], "long" );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("", handler).get<std::string>() );
+  EXPECT_EQ( reported[1], "string" );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("far", handler).get<Distance>() );
+  EXPECT_NE( reported[1].find("Distance"), std::string::npos );
+}
+
+TEST(StringStoreTests, IntWhitespace) {
+  ArgOpts::StringStore s(" +42 ");
+  int val = s;
+  ASSERT_EQ(val, 42);
+}
+
+TEST(StringStoreTests, IntRange) {
+  EXPECT_EQ( ArgOpts::StringStore("-2147483648").get<int>(), -2147483648LL );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("2147483648").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("99999999999999999999").get<long long>() );
+  EXPECT_EQ( ArgOpts::StringStore("-32768").get<short>(), -32768 );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("32768").get<short>() );
+}
+
+TEST(StringStoreTests, UnsignedTest) {
+  EXPECT_EQ( ArgOpts::StringStore("4294967295").get<unsigned int>(), 4294967295u );
+  EXPECT_EQ( ArgOpts::StringStore("18446744073709551615").get<unsigned long long>(),
+             18446744073709551615ull );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("4294967296").get<unsigned int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("-1").get<unsigned int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore(" -1").get<unsigned long>() );
+}
+
+TEST(StringStoreTests, IntTrailingFail) {
+  EXPECT_ANY_THROW( ArgOpts::StringStore("12abc").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("12 3").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("-").get<int>() );
+}
+
+TEST(StringStoreTests, IntRadixPrefix) {
+  EXPECT_EQ( ArgOpts::StringStore("0x1f").get<int>(), 31 );
+  EXPECT_EQ( ArgOpts::StringStore("0XFF").get<int>(), 255 );
+  EXPECT_EQ( ArgOpts::StringStore("-0x80").get<int>(), -128 );
+  EXPECT_EQ( ArgOpts::StringStore("0o17").get<int>(), 15 );
+  EXPECT_EQ( ArgOpts::StringStore("0b1010").get<int>(), 10 );
+  EXPECT_EQ( ArgOpts::StringStore("+0b1").get<unsigned>(), 1u );
+  // A leading zero is still decimal
+  EXPECT_EQ( ArgOpts::StringStore("010").get<int>(), 10 );
+  EXPECT_EQ( ArgOpts::StringStore("0").get<int>(), 0 );
+  EXPECT_EQ( ArgOpts::StringStore("0xffffffffffffffff").get<unsigned long long>(),
+             18446744073709551615ull );
+
+  EXPECT_ANY_THROW( ArgOpts::StringStore("0x").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("0b102").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("0o8").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("0xfg").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1f").get<int>() );
+}
+
+TEST(StringStoreTests, IntSeparators) {
+  EXPECT_EQ( ArgOpts::StringStore("1_000_000").get<int>(), 1000000 );
+  EXPECT_EQ( ArgOpts::StringStore("0xffff_ffff").get<unsigned>(), 4294967295u );
+  EXPECT_EQ( ArgOpts::StringStore("-0b1000_0000").get<int>(), -128 );
+
+  EXPECT_ANY_THROW( ArgOpts::StringStore("_1").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1_").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1__0").get<int>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("0x_1").get<int>() );
+}
+
+TEST(StringStoreTests, IntOverflowStatus) {
+  using ArgOpts::ConversionStatus;
+  EXPECT_EQ( ArgOpts::StringStore("127").get<short>(), 127 );
+  EXPECT_EQ( ArgOpts::StringStore("-9223372036854775808").get<long long>(),
+             std::numeric_limits<long long>::min() );
+  EXPECT_EQ( ArgOpts::StringStore("9223372036854775808").tryGet<long long>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("-9223372036854775809").tryGet<long long>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("18446744073709551616").tryGet<unsigned long long>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("0x1_0000_0000").tryGet<unsigned>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("-0").get<unsigned>(), 0u );
+  // Syntax errors are reported in preference to overflow
+  EXPECT_EQ( ArgOpts::StringStore("99999999999999999999x").tryGet<long>().status(),
+             ConversionStatus::invalid );
+
+  try {
+    int val = ArgOpts::StringStore("3000000000");
+    FAIL() << "Expected exception, got " << val;
+  } catch (const std::invalid_argument &e) {
+    EXPECT_NE( std::string(e.what()).find("out of range"), std::string::npos );
+  }
+}
+
+TEST(StringStoreTests, FloatTest) {
+  EXPECT_FLOAT_EQ( ArgOpts::StringStore("2.5e3").get<float>(), 2500.0f );
+  EXPECT_DOUBLE_EQ( ArgOpts::StringStore("-1.25e-3").get<double>(), -1.25e-3 );
+  EXPECT_DOUBLE_EQ( static_cast<double>(ArgOpts::StringStore("0.5").get<long double>()), 0.5 );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1e400").get<double>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1e40").get<float>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1.5x").get<double>() );
+}
+
+namespace {
+  /// Sets LC_NUMERIC to a locale with a decimal comma, if one is
+  /// installed, and restores it afterwards
+  class CommaLocale {
+  public:
+    CommaLocale() : previous(std::setlocale(LC_NUMERIC, nullptr)) {
+      for (const char *name : {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR",
+                               "German", "French"}) {
+        if (std::setlocale(LC_NUMERIC, name) != nullptr) {
+          if (std::string(std::localeconv()->decimal_point) == ",") {
+            return;
+          }
+        }
+      }
+      std::setlocale(LC_NUMERIC, previous.c_str());
+      previous.clear();
+    }
+    ~CommaLocale() {
+      if (!previous.empty()) {
+        std::setlocale(LC_NUMERIC, previous.c_str());
+      }
+    }
+
+    bool active() const { return !previous.empty(); }
+
+  private:
+    std::string previous; ///< Locale to restore, or empty if not changed
+  };
+}
+
+TEST(StringStoreTests, FloatIgnoresLocale) {
+  CommaLocale locale;
+  if (!locale.active()) {
+    GTEST_SKIP() << "no locale with a decimal comma is installed";
+  }
+  EXPECT_DOUBLE_EQ( ArgOpts::StringStore("1.5").get<double>(), 1.5 );
+  EXPECT_FLOAT_EQ( ArgOpts::StringStore("-2.25e1").get<float>(), -22.5f );
+  EXPECT_DOUBLE_EQ( static_cast<double>(ArgOpts::StringStore("0.5").get<long double>()), 0.5 );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("1,5").get<double>() );
+
+  // Formatted as by a stream, which doesn't use LC_NUMERIC
+  EXPECT_EQ( ArgOpts::StringStore(1.5).str(), "1.5" );
+  EXPECT_EQ( ArgOpts::StringStore(-2.25e-10f).str(), "-2.25e-10" );
+  EXPECT_EQ( ArgOpts::StringStore(0.125L).str(), "0.125" );
+}
+
+TEST(StringStoreTests, BorrowNotTerminated) {
+  const char text[] = "123456";
+  ArgOpts::StringStore s = ArgOpts::StringStore::borrow(ArgOpts::StringRef(text, 3));
+  EXPECT_EQ( s.get<int>(), 123 );
+}
+
+TEST(StringStoreTests, ConvertedOnce) {
+  char text[] = "42";
+  ArgOpts::StringStore s = ArgOpts::StringStore::borrow(text);
+  ArgOpts::Converted<int> value(s);
+  EXPECT_EQ( value.get(), 42 );
+
+  // The value is kept, while get() converts the text each time
+  text[0] = '1';
+  EXPECT_EQ( static_cast<int>(value), 42 );
+  EXPECT_EQ( s.get<int>(), 12 );
+
+  EXPECT_ANY_THROW( ArgOpts::Converted<int>(ArgOpts::StringStore("3.5")) );
+}
+
+TEST(StringStoreTests, OptionIsSmall) {
+  // A view and an owner or small buffer, the handler, names and help
+  EXPECT_LE( sizeof(ArgOpts::StringStore), 6 * sizeof(void *) );
+  EXPECT_LE( sizeof(ArgOpts::Option), 11 * sizeof(void *) );
+}
+
+TEST(StringStoreTests, BorrowTest) {
+  char text[] = "42";
+  ArgOpts::StringStore s = ArgOpts::StringStore::borrow(text);
+  EXPECT_EQ( s.view().data(), text );
+  EXPECT_EQ( s.view(), "42" );
+
+  int val = s;
+  EXPECT_EQ( val, 42 );
+
+  text[0] = '5';
+  EXPECT_EQ( s.str(), "52" );
+}
+
+TEST(StringStoreTests, BorrowEmptyFail) {
+  ArgOpts::StringStore s = ArgOpts::StringStore::borrow("");
+  ASSERT_ANY_THROW(std::string str = s;);
+}
+
+TEST(StringStoreTests, TryGetStatus) {
+  using ArgOpts::ConversionStatus;
+  EXPECT_EQ( ArgOpts::StringStore("42").tryGet<int>().status(), ConversionStatus::ok );
+  EXPECT_EQ( *ArgOpts::StringStore("42").tryGet<int>(), 42 );
+  EXPECT_EQ( ArgOpts::StringStore().tryGet<int>().status(), ConversionStatus::missing );
+  EXPECT_EQ( ArgOpts::StringStore("4x").tryGet<int>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("99999999999").tryGet<int>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("-1").tryGet<unsigned>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("1e999").tryGet<double>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("far").tryGet<Distance>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore().tryGet<std::string>().status(), ConversionStatus::missing );
+  EXPECT_EQ( *ArgOpts::StringStore("text").tryGet<std::string>(), "text" );
+}
+
+TEST(StringStoreTests, TryGetDoesNotCallHandler) {
+  std::vector<std::string> reported;
+  ArgOpts::StringStore s("x", {recordError, &reported});
+  ArgOpts::Expected<double> val = s.tryGet<double>();
+  EXPECT_FALSE( val );
+  EXPECT_TRUE( reported.empty() );
+  EXPECT_DOUBLE_EQ( val.valueOr(1.5), 1.5 );
+  EXPECT_ANY_THROW( val.value() );
+}
+
+TEST(StringStoreTests, BoolWords) {
+  for (const char *word : {"1", "true", "Yes", "ON", " on "}) {
+    EXPECT_TRUE( ArgOpts::StringStore(word).get<bool>() ) << word;
+  }
+  for (const char *word : {"0", "false", "no", "Off"}) {
+    EXPECT_FALSE( ArgOpts::StringStore(word).get<bool>() ) << word;
+  }
+  EXPECT_ANY_THROW( ArgOpts::StringStore("2").get<bool>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("yess").get<bool>() );
+  EXPECT_ANY_THROW( ArgOpts::StringStore("truefalse").get<bool>() );
+}
+
+enum class Colour { red, green, blue };
+
+namespace ArgOpts {
+  template <> struct EnumNames<Colour> {
+    static std::vector<EnumName<Colour>> get() {
+      return { {"red", Colour::red}, {"green", Colour::green}, {"blue", Colour::blue},
+               {"verde", Colour::green} };
+    }
+  };
+}
+
+TEST(StringStoreTests, EnumNames) {
+  Colour colour = ArgOpts::StringStore("green");
+  EXPECT_EQ( colour, Colour::green );
+  EXPECT_EQ( ArgOpts::StringStore("verde").get<Colour>(), Colour::green );
+  EXPECT_EQ( ArgOpts::StringStore("blue").get<Colour>(), Colour::blue );
+  EXPECT_EQ( ArgOpts::StringStore("purple").tryGet<Colour>().status(),
+             ArgOpts::ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("Red").tryGet<Colour>().status(),
+             ArgOpts::ConversionStatus::invalid );
+}
+
+TEST(StringStoreTests, Durations) {
+  using namespace std::chrono;
+  EXPECT_EQ( ArgOpts::StringStore("250ms").get<milliseconds>(), milliseconds(250) );
+  EXPECT_EQ( ArgOpts::StringStore("2s").get<milliseconds>(), milliseconds(2000) );
+  EXPECT_EQ( ArgOpts::StringStore("1h").get<seconds>(), seconds(3600) );
+  EXPECT_EQ( ArgOpts::StringStore("90 min").get<minutes>(), minutes(90) );
+  EXPECT_EQ( ArgOpts::StringStore("-5s").get<seconds>(), seconds(-5) );
+  EXPECT_EQ( ArgOpts::StringStore("30").get<seconds>(), seconds(30) );
+  EXPECT_EQ( ArgOpts::StringStore("1d").get<hours>(), hours(24) );
+  EXPECT_DOUBLE_EQ( ArgOpts::StringStore("1.5s").get<duration<double>>().count(), 1.5 );
+  EXPECT_DOUBLE_EQ( ArgOpts::StringStore("20ms").get<duration<double>>().count(), 0.02 );
+
+  using ArgOpts::ConversionStatus;
+  // Not a whole number of milliseconds
+  EXPECT_EQ( ArgOpts::StringStore("1500us").tryGet<milliseconds>().status(),
+             ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("5 parsecs").tryGet<seconds>().status(),
+             ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("ms").tryGet<seconds>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("9223372036854775807h").tryGet<nanoseconds>().status(),
+             ConversionStatus::out_of_range );
+  using short_hours = duration<short, std::ratio<3600>>;
+  EXPECT_EQ( ArgOpts::StringStore("100000h").tryGet<short_hours>().status(),
+             ConversionStatus::out_of_range );
+}
+
+TEST(StringStoreTests, FractionalDurations) {
+  using namespace std::chrono;
+  EXPECT_EQ( ArgOpts::StringStore("1.5s").get<milliseconds>(), milliseconds(1500) );
+  EXPECT_EQ( ArgOpts::StringStore("0.25h").get<minutes>(), minutes(15) );
+  EXPECT_EQ( ArgOpts::StringStore(".5ms").get<microseconds>(), microseconds(500) );
+  EXPECT_EQ( ArgOpts::StringStore("-0.001s").get<nanoseconds>(), nanoseconds(-1000000) );
+  EXPECT_EQ( ArgOpts::StringStore("1.0001s").tryGet<milliseconds>().status(),
+             ArgOpts::ConversionStatus::invalid );
+}
+
+TEST(StringStoreTests, ByteSizes) {
+  using ArgOpts::ByteSize;
+  EXPECT_EQ( ArgOpts::StringStore("512").get<ByteSize>(), 512u );
+  EXPECT_EQ( ArgOpts::StringStore("512B").get<ByteSize>(), 512u );
+  EXPECT_EQ( ArgOpts::StringStore("512MiB").get<ByteSize>(), 512ull << 20 );
+  EXPECT_EQ( ArgOpts::StringStore("4k").get<ByteSize>(), 4096u );
+  EXPECT_EQ( ArgOpts::StringStore("4kB").get<ByteSize>(), 4000u );
+  EXPECT_EQ( ArgOpts::StringStore("2 GB").get<ByteSize>(), 2000000000ull );
+  EXPECT_EQ( ArgOpts::StringStore("1.5G").get<ByteSize>(), 3ull << 29 );
+  EXPECT_EQ( ArgOpts::StringStore("15EiB").get<ByteSize>(), 15ull << 60 );
+  std::uint64_t bytes = ArgOpts::StringStore("1.25KiB").get<ByteSize>();
+  EXPECT_EQ( bytes, 1280u );
+
+  using ArgOpts::ConversionStatus;
+  EXPECT_EQ( ArgOpts::StringStore("16EiB").tryGet<ByteSize>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("99999999999999999999").tryGet<ByteSize>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("-1k").tryGet<ByteSize>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore("1.5B").tryGet<ByteSize>().status(),
+             ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("12 parsecs").tryGet<ByteSize>().status(),
+             ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("MiB").tryGet<ByteSize>().status(),
+             ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::TypeName<ByteSize>::get(), "size" );
+}
+
+TEST(StringStoreTests, ListValues) {
+  std::vector<int> ints = ArgOpts::StringStore("1,2, 3,0x10");
+  EXPECT_EQ( ints, std::vector<int>({1, 2, 3, 16}) );
+  EXPECT_EQ( ArgOpts::StringStore("42").get<std::vector<int>>(), std::vector<int>({42}) );
+
+  std::vector<double> doubles = ArgOpts::StringStore("1.5;-2;3e2").getList<double>(';');
+  EXPECT_EQ( doubles, std::vector<double>({1.5, -2, 300}) );
+
+  std::vector<std::string> paths = ArgOpts::StringStore("/usr/lib:/my lib").getList<std::string>(':');
+  EXPECT_EQ( paths, std::vector<std::string>({"/usr/lib", "/my lib"}) );
+
+  std::vector<ArgOpts::ByteSize> sizes = ArgOpts::StringStore("4k,1MiB").getList<ArgOpts::ByteSize>();
+  ASSERT_EQ( sizes.size(), 2 );
+  EXPECT_EQ( sizes[1], 1u << 20 );
+
+  // Borrowed values need not end with a null
+  const char text[] = "7,8,9";
+  EXPECT_EQ( ArgOpts::StringStore::borrow(ArgOpts::StringRef(text, 3)).getList<int>(),
+             std::vector<int>({7, 8}) );
+}
+
+TEST(StringStoreTests, ListValuesFail) {
+  using ArgOpts::ConversionStatus;
+  EXPECT_EQ( ArgOpts::StringStore("1,,2").tryGetList<int>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("1,2,").tryGetList<int>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("1,x").tryGetList<int>().status(), ConversionStatus::invalid );
+  EXPECT_EQ( ArgOpts::StringStore("1,99999999999").tryGetList<int>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::StringStore().tryGetList<int>().status(), ConversionStatus::missing );
+
+  std::vector<std::string> reported;
+  ArgOpts::StringStore s("1,x", {recordError, &reported});
+  EXPECT_ANY_THROW( s.getList<int>() );
+  ASSERT_EQ( reported.size(), 2 );
+  EXPECT_EQ( reported[1], "list of int" );
+}
+
+TEST(StringStoreTests, IntervalSet) {
+  ArgOpts::IntervalSet ranks = ArgOpts::StringStore("4000-4095, 2048,0-1023,1024-1030,2047");
+  ASSERT_EQ( ranks.intervals().size(), 3 );
+  EXPECT_EQ( ranks.intervals()[0].first, 0 );
+  EXPECT_EQ( ranks.intervals()[0].last, 1030 );
+  EXPECT_EQ( ranks.intervals()[1].first, 2047 );
+  EXPECT_EQ( ranks.intervals()[1].last, 2048 );
+  EXPECT_EQ( ranks.count(), 1031u + 2 + 96 );
+
+  EXPECT_TRUE( ranks.contains(0) );
+  EXPECT_TRUE( ranks.contains(1030) );
+  EXPECT_FALSE( ranks.contains(1031) );
+  EXPECT_TRUE( ranks.contains(2048) );
+  EXPECT_FALSE( ranks.contains(-1) );
+  EXPECT_TRUE( ranks.contains(4095) );
+  EXPECT_FALSE( ranks.contains(4096) );
+
+  ArgOpts::IntervalSet small = ArgOpts::StringStore("-3--1,5,0x10-0x11");
+  std::vector<long long> values(small.begin(), small.end());
+  EXPECT_EQ( values, std::vector<long long>({-3, -2, -1, 5, 16, 17}) );
+
+  // A million elements in one interval
+  ArgOpts::IntervalSet large = ArgOpts::StringStore("0-999_999");
+  EXPECT_EQ( large.intervals().size(), 1 );
+  EXPECT_EQ( large.count(), 1000000u );
+
+  large.insert(1000000);
+  large.insert(-5, -2);
+  EXPECT_EQ( large.intervals().size(), 2 );
+  EXPECT_TRUE( large.contains(1000000) );
+}
+
+TEST(StringStoreTests, IntervalSetFail) {
+  using ArgOpts::ConversionStatus;
+  for (const char *value : {"5-3", "1,,2", "1-", "-", "1-2-3", "a-b", "1,"}) {
+    EXPECT_EQ( ArgOpts::StringStore(value).tryGet<ArgOpts::IntervalSet>().status(),
+               ConversionStatus::invalid ) << value;
+  }
+  EXPECT_EQ( ArgOpts::StringStore("0-99999999999999999999").tryGet<ArgOpts::IntervalSet>().status(),
+             ConversionStatus::out_of_range );
+  EXPECT_EQ( ArgOpts::TypeName<ArgOpts::IntervalSet>::get(), "integer set" );
+
+  // Reversed bounds are rejected, as when converting, rather than stored
+  ArgOpts::IntervalSet set;
+  EXPECT_THROW( set.insert(5, 3), std::invalid_argument );
+  EXPECT_TRUE( set.intervals().empty() );
+  EXPECT_EQ( set.count(), 0u );
+}
+
+namespace {
+  /// Write a file in the test directory, returning its path
+  std::string writeTestFile(const std::string &name, const std::string &text) {
+    std::string path = testing::TempDir() + name;
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+    return path;
+  }
+}
+
+TEST(StringStoreTests, FileContents) {
+  std::string text = "{\"key\": [1, 2, 3]}\n";
+  for (int n = 0; n < 1000; n++) {
+    text += "line " + std::to_string(n) + "\n";
+  }
+  const std::string path = writeTestFile("argopts_contents.json", text);
+
+  ArgOpts::StringStore data;
+  {
+    ArgOpts::StringStore s("@" + path);
+    data = s.contents();
+  }
+  EXPECT_EQ( data.view(), text );
+  ArgOpts::StringStore copy = data;
+  data = ArgOpts::StringStore();
+  EXPECT_EQ( copy.str(), text );
+
+  // Values without '@' are returned unchanged
+  EXPECT_EQ( ArgOpts::StringStore("1,2,3").contents().getList<int>(), std::vector<int>({1, 2, 3}) );
+
+  const std::string list = writeTestFile("argopts_list.txt", "1.5,2.5,3.5\n");
+  EXPECT_EQ( ArgOpts::StringStore("@" + list).contents().getList<double>(),
+             std::vector<double>({1.5, 2.5, 3.5}) );
+
+  const std::string empty = writeTestFile("argopts_empty.txt", "");
+  EXPECT_EQ( ArgOpts::StringStore("@" + empty).contents().view(), "" );
+}
+
+TEST(StringStoreTests, FileContentsFail) {
+  ArgOpts::StringStore s("@/no/such/file/for/argopts");
+  EXPECT_EQ( s.tryContents().status(), ArgOpts::ConversionStatus::unreadable );
+  EXPECT_ANY_THROW( s.contents() );
+
+  ArgOpts::Parser parser = { {'d', "data", "[@FILE] input data"} };
+  const char* argv[] = {"somecode", "--data=@/no/such/file/for/argopts"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+  ASSERT_EQ( args.size(), 1 );
+  try {
+    args[0].arg.contents();
+    FAIL() << "Expected exception";
+  } catch (const std::invalid_argument &e) {
+    EXPECT_NE( std::string(e.what()).find("Could not read file '/no/such/file/for/argopts'\n"
+                                          "usage: -d, --data"), std::string::npos );
+  }
+}
+
+TEST(StringStoreTests, FileContentsErrorTruncated) {
+  // Error messages give the start of a large value, not all of it
+  const std::string text(100000, '7');
+  const std::string path = writeTestFile("argopts_large.txt", text + "x");
+  const std::string start = "got '" + text.substr(0, 60) + "...' (100001 characters)\n";
+
+  ArgOpts::Parser parser = { {'d', "data", "[@FILE] input data"} };
+  const std::string value = "--data=@" + path;
+  const char* argv[] = {"somecode", value.c_str()};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+  ASSERT_EQ( args.size(), 1 );
+  try {
+    args[0].arg.contents().get<int>();
+    FAIL() << "Expected exception";
+  } catch (const std::invalid_argument &e) {
+    const std::string message = e.what();
+    EXPECT_LT( message.size(), 200 );
+    EXPECT_NE( message.find(start), std::string::npos ) << message;
+  }
+
+  try {
+    ArgOpts::StringStore("@" + path).contents().get<int>();
+    FAIL() << "Expected exception";
+  } catch (const std::invalid_argument &e) {
+    EXPECT_EQ( std::string(e.what()), "could not convert '" + text.substr(0, 60) +
+               "...' (100001 characters) to int: invalid value" );
+  }
+}
+
+TEST(StringStoreTests, CustomConvert) {
+  std::vector<std::string> reported;
+  ArgOpts::StringStore s("1m", {recordError, &reported});
+  EXPECT_ANY_THROW( s.get<std::chrono::seconds>() );
+  ASSERT_EQ( reported.size(), 2 );
+  EXPECT_EQ( reported[1], "duration" );
+}
+
+///////////////////////////////////////////////////
+
+TEST(StringRefTests, Compare) {
+  std::string str = "value";
+  ArgOpts::StringRef ref(str);
+  EXPECT_EQ( ref.data(), str.data() );
+  EXPECT_TRUE( ref == "value" );
+  EXPECT_TRUE( ref == str );
+  EXPECT_TRUE( ref != "values" );
+  EXPECT_TRUE( ref != "valuf" );
+  EXPECT_TRUE( ArgOpts::StringRef() == "" );
+}
+
+TEST(StringRefTests, FindAndSubstr) {
+  ArgOpts::StringRef ref("name=value");
+  std::size_t pos = ref.find('=');
+  EXPECT_EQ( pos, 4 );
+  EXPECT_EQ( ref.substr(0, pos), "name" );
+  EXPECT_EQ( ref.substr(pos + 1), "value" );
+  EXPECT_EQ( ref.substr(20), "" );
+  EXPECT_EQ( ref.find('x'), ArgOpts::StringRef::npos );
+  EXPECT_EQ( ref.find('=', 5), ArgOpts::StringRef::npos );
+}
+
 ///////////////////////////////////////////////////
 
 TEST(ParserSimpleTests, EmptyParseTest) {
@@ -171,6 +780,741 @@ TEST(ParserSimpleTests, TwoShortArgs) {
   EXPECT_ANY_THROW( std::string str = opt.arg; );
 }
 
+TEST(ParserSimpleTests, BorrowValues) {
+  const char* argv[] = {"somecode", "--thing=value", "-ab", "next"};
+  auto args = ArgOpts::Parser().parse(4, const_cast<char**>(argv),
+                                      ArgOpts::ValueStorage::borrow);
+
+  ASSERT_EQ( args.size(), 3 );
+
+  auto it = args.begin();
+  EXPECT_EQ( it->longopt, "thing" );
+  EXPECT_EQ( it->arg.view(), "value" );
+  EXPECT_EQ( it->arg.view().data(), argv[1] + 8 );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'a' );
+  EXPECT_EQ( it->arg.view().data(), argv[3] );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'b' );
+  EXPECT_EQ( it->arg.view().data(), argv[3] );
+  std::string str = it->arg;
+  EXPECT_EQ( str, "next" );
+}
+
+///////////////////////////////////////////////////
+
+TEST(ParserOptionsTests, MatchLongOption) {
+  ArgOpts::Parser parser = { {'h', "help", "print help"},
+                             {'n', "number", "some number"} };
+  const char* argv[] = {"somecode", "--number=3"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 1 );
+
+  ArgOpts::Option& opt = args.front();
+  EXPECT_EQ( opt.shortopt, 'n' );
+  EXPECT_EQ( opt.longopt, "number" );
+  EXPECT_EQ( opt.help, "some number" );
+  EXPECT_EQ( opt.index, 1 );
+  int val = opt.arg;
+  EXPECT_EQ( val, 3 );
+}
+
+TEST(ParserOptionsTests, MatchGroupedShortOptions) {
+  ArgOpts::Parser parser = { {'a', "alpha", "first"},
+                             {'b', "beta", "second"} };
+  const char* argv[] = {"somecode", "-bca"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 3 );
+
+  auto it = args.begin();
+  EXPECT_EQ( it->shortopt, 'b' );
+  EXPECT_EQ( it->longopt, "beta" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'c' );
+  EXPECT_EQ( it->longopt, "" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'a' );
+  EXPECT_EQ( it->longopt, "alpha" );
+}
+
+TEST(ParserOptionsTests, ResultsReferToSpec) {
+  ArgOpts::Parser parser = { {'v', "verbose", "print more, with a long help message"} };
+  const char* argv[] = {"somecode", "-vvv", "--verbose"};
+  auto args = parser.parse(3, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 4 );
+  const ArgOpts::OptionSpec *spec = parser.findShort('v');
+  for (auto &opt : args) {
+    EXPECT_EQ( opt.shortopt, 'v' );
+    EXPECT_EQ( opt.longopt.data(), spec->longopt.data() );
+    EXPECT_EQ( opt.help.data(), spec->help.data() );
+  }
+}
+
+TEST(ParserOptionsTests, UnknownLongNameCopied) {
+  std::string arg = "--thing=value";
+  char* argv[] = {const_cast<char*>("somecode"), &arg[0]};
+  auto args = ArgOpts::Parser().parse(2, argv);
+  arg = "--other=thing";
+
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args[0].longopt, "thing" );
+  EXPECT_EQ( args[0].arg.view(), "value" );
+
+  // Copies share the name and value
+  ArgOpts::Option copy = args[0];
+  args.clear();
+  EXPECT_EQ( copy.longopt, "thing" );
+  EXPECT_EQ( copy.arg.view(), "value" );
+}
+
+TEST(ParserOptionsTests, GroupedShareValue) {
+  std::string value(1000, 'x');
+  char* argv[] = {const_cast<char*>("somecode"), const_cast<char*>("-abc"), &value[0]};
+  auto args = ArgOpts::Parser().parse(3, argv);
+  value[0] = 'y';
+
+  ASSERT_EQ( args.size(), 3 );
+  for (auto &opt : args) {
+    EXPECT_EQ( opt.arg.view(), std::string(1000, 'x') );
+    EXPECT_NE( opt.arg.view().data(), argv[2] );
+  }
+  // After the first, options share a copy
+  EXPECT_EQ( args[2].arg.view().data(), args[1].arg.view().data() );
+}
+
+TEST(ParserOptionsTests, ErrorMessageUsage) {
+  ArgOpts::Parser parser = { {'n', "number", "some number"} };
+  // More options than arguments, so the result must grow
+  const char* argv[] = {"somecode", "-abcdefghijklmnopqrstuvwxyz", "value"};
+  auto args = parser.parse(3, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 26 );
+
+  ArgOpts::Option& opt = args[13];
+  EXPECT_EQ( opt.shortopt, 'n' );
+  try {
+    int val = opt.arg;
+    FAIL() << "Expected exception, got " << val;
+  } catch (const std::invalid_argument &e) {
+    EXPECT_NE( std::string(e.what()).find("usage: -n, --number\t\tsome number"),
+               std::string::npos );
+  }
+}
+
+namespace {
+  /// The message of the exception thrown by converting the value to int
+  std::string intErrorMessage(const ArgOpts::Option &opt) {
+    try {
+      int val = opt.arg;
+      return "no error, got " + std::to_string(val);
+    } catch (const std::invalid_argument &e) {
+      return e.what();
+    }
+  }
+}
+
+TEST(ParserOptionsTests, CopiedResultsKeepUsage) {
+  ArgOpts::Parser parser = { {'n', "number", "some number"} };
+  const char* argv[] = {"somecode", "-n", "x", "--other=y", "-q"};
+  for (auto storage : {ArgOpts::ValueStorage::copy, ArgOpts::ValueStorage::borrow}) {
+    ArgOpts::options_list copies;
+    {
+      auto args = parser.parse(5, const_cast<char**>(argv), storage);
+      ASSERT_EQ( args.size(), 3 );
+      copies.assign(args.begin(), args.end());
+    }
+    EXPECT_NE( intErrorMessage(copies[0]).find("got 'x'\nusage: -n, --number\t\tsome number"),
+               std::string::npos );
+    EXPECT_NE( intErrorMessage(copies[1]).find("got 'y'\nusage: --other\n"), std::string::npos );
+    EXPECT_NE( intErrorMessage(copies[2]).find("Missing argument, expected type int\nusage: -q\n"),
+               std::string::npos );
+  }
+}
+
+TEST(ParserOptionsTests, OutOfRangeMessage) {
+  ArgOpts::Parser parser = { {'n', "number", "some number"} };
+  const char* argv[] = {"somecode", "--number=0x1_0000_0000"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_NE( intErrorMessage(args[0]).find("Argument out of range: expected type int"),
+             std::string::npos );
+}
+
+TEST(ParserOptionsTests, FirstLongOptionTakesPrecedence) {
+  ArgOpts::Parser parser;
+  parser.add('a', "thing", "first");
+  parser.add('b', "thing", "second");
+
+  const char* argv[] = {"somecode", "--thing"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args.front().shortopt, 'a' );
+}
+
+namespace {
+  /// True if parse(argc, argv) can be called on an expression of type P
+  template <typename P, typename = void>
+  struct CanParse : std::false_type {};
+
+  template <typename P>
+  struct CanParse<P, decltype(void(std::declval<P>().parse(0, nullptr)))> : std::true_type {};
+
+  /// True if a ParseSession can parse with an expression of type P
+  template <typename P, typename = void>
+  struct CanParseSession : std::false_type {};
+
+  template <typename P>
+  struct CanParseSession<P, decltype(void(std::declval<ArgOpts::ParseSession &>().parse(
+                                0, nullptr, std::declval<P>())))> : std::true_type {};
+}
+
+TEST(ParserOptionsTests, TemporaryParser) {
+  EXPECT_TRUE( (CanParse<const ArgOpts::Parser &>::value) );
+  EXPECT_TRUE( (CanParse<ArgOpts::Parser>::value) );
+  EXPECT_TRUE( (CanParse<ArgOpts::CompiledParser>::value) );
+  // A session's results refer to the parser, so it must outlive them
+  EXPECT_TRUE( (CanParseSession<const ArgOpts::Parser &>::value) );
+  EXPECT_FALSE( (CanParseSession<ArgOpts::Parser>::value) );
+
+  // The names and help are copied, so the results outlive the parser
+  std::string value(100, 'x');
+  char* argv[] = {const_cast<char*>("somecode"), const_cast<char*>("-nv"), &value[0],
+                  const_cast<char*>("--other=7")};
+  for (auto storage : {ArgOpts::ValueStorage::copy, ArgOpts::ValueStorage::borrow}) {
+    auto args = ArgOpts::Parser({{'n', "number", "[N] some number"},
+                                 {'v', "verbose", "print more"}}).parse(4, argv, storage);
+    ASSERT_EQ( args.size(), 3 );
+    EXPECT_EQ( args[0].longopt, "number" );
+    EXPECT_EQ( args[0].help, "[N] some number" );
+    EXPECT_EQ( args[1].help, "print more" );
+    EXPECT_EQ( args[2].longopt, "other" );
+    EXPECT_EQ( args[2].arg.get<int>(), 7 );
+    // Grouped options share one value, which is copied unless borrowed
+    EXPECT_EQ( args[0].arg.view().data(), args[1].arg.view().data() );
+    EXPECT_EQ( args[0].arg.view().data() == value.data(),
+               storage == ArgOpts::ValueStorage::borrow );
+    EXPECT_EQ( args[0].arg.str(), value );
+    try {
+      args[0].arg.get<int>();
+      FAIL() << "Expected exception";
+    } catch (const std::invalid_argument &e) {
+      EXPECT_NE( std::string(e.what()).find("usage: -n, --number\t\t[N] some number\n"),
+                 std::string::npos );
+    }
+  }
+
+  auto frozen = ArgOpts::Parser({{'h', "help", "print help"}}).freeze().parse(2, argv);
+  ASSERT_EQ( frozen.size(), 2 );
+  EXPECT_EQ( frozen[0].shortopt, 'n' );
+  EXPECT_EQ( frozen[0].help, "" );
+}
+
+TEST(ParserOptionsTests, CopiedParserMatches) {
+  ArgOpts::Parser original = { {'h', "help", "print help"} };
+  ArgOpts::Parser parser = original;
+  original = ArgOpts::Parser();
+
+  const char* argv[] = {"somecode", "--help"};
+  auto args = parser.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args.front().shortopt, 'h' );
+  EXPECT_EQ( args.front().help, "print help" );
+}
+
+TEST(ParserOptionsTests, MovedFromParserReused) {
+  ArgOpts::Parser original = { {'h', "help", "print help"} };
+  const char* argv[] = {"somecode", "-h"};
+  {
+    ArgOpts::Parser moved = std::move(original);
+    auto args = moved.parse(2, const_cast<char**>(argv));
+    ASSERT_EQ( args.size(), 1 );
+    EXPECT_EQ( args.front().help, "print help" );
+  }
+  // The moved-from parser doesn't refer to the destroyed options,
+  // so 'h' can be added again
+  original.add('h', "halt", "stop");
+  auto args = original.parse(2, const_cast<char**>(argv));
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args.front().help, "stop" );
+
+  ArgOpts::Parser assigned;
+  assigned = std::move(original);
+  original.add('x', "", "other");
+  const char* argv2[] = {"somecode", "-xh"};
+  args = original.parse(2, const_cast<char**>(argv2));
+  ASSERT_EQ( args.size(), 2 );
+  EXPECT_EQ( args[0].help, "other" );
+  EXPECT_EQ( args[1].shortopt, 'h' );
+  EXPECT_EQ( args[1].help, "" );
+  EXPECT_EQ( assigned.findShort('h')->help, "stop" );
+}
+
+TEST(ParserOptionsTests, Arity) {
+  ArgOpts::Parser parser = { {'v', "verbose", "", ArgOpts::Arity::flag},
+                             {'n', "number", "[N]", ArgOpts::Arity::required},
+                             {'o', "output", "[FILE]", ArgOpts::Arity::optional},
+                             {0, "size", "[W H]", ArgOpts::Arity::values(2)} };
+
+  const char* argv[] = {"somecode", "-v", "input", "-n", "-5", "--size", "640", "-v",
+                        "-o", "--output=out", "-vn7"};
+  auto args = parser.parse(11, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 8 );
+  EXPECT_EQ( args[0].shortopt, 'v' );
+  EXPECT_EQ( args[0].arg.str(), "" );
+  EXPECT_EQ( args[1].shortopt, 'n' );
+  EXPECT_EQ( args[1].arg.get<int>(), -5 );
+  EXPECT_EQ( args[2].longopt, "size" );
+  EXPECT_EQ( args[2].arg.str(), "640" );
+  EXPECT_EQ( args[3].longopt, "size" );
+  EXPECT_EQ( args[3].arg.str(), "-v" );
+  EXPECT_EQ( args[3].index, 5 );
+  EXPECT_EQ( args[4].shortopt, 'o' );
+  EXPECT_EQ( args[4].arg.str(), "" );
+  EXPECT_EQ( args[5].arg.str(), "out" );
+  EXPECT_EQ( args[6].shortopt, 'v' );
+  EXPECT_EQ( args[7].shortopt, 'n' );
+  EXPECT_EQ( args[7].arg.get<int>(), 7 );
+}
+
+TEST(ParserOptionsTests, ArityMissingValue) {
+  ArgOpts::Parser parser;
+  parser.add('n', "number", "[N]", ArgOpts::Arity::required);
+  parser.add('x', "", "", ArgOpts::Arity::flag);
+
+  const char* argv[] = {"somecode", "-x", "--number"};
+  auto args = parser.parse(3, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 2 );
+  EXPECT_FALSE( args[1].arg.tryGet<int>() );
+  EXPECT_EQ( args[1].arg.tryGet<int>().status(), ArgOpts::ConversionStatus::missing );
+
+  // Without an arity the next argument is used, and scanned as an option
+  ArgOpts::Parser speculative = { {'n', "number", "[N]"}, {'x', "", ""} };
+  const char* argv2[] = {"somecode", "-n", "-x"};
+  args = speculative.parse(3, const_cast<char**>(argv2));
+
+  ASSERT_EQ( args.size(), 2 );
+  EXPECT_EQ( args[0].arg.str(), "-x" );
+  EXPECT_EQ( args[1].shortopt, 'x' );
+}
+
+TEST(ParserOptionsTests, ArityFlagInGroup) {
+  // A value after '=' in a group is not given to flags
+  bool verbose = false;
+  int number = 0;
+  ArgOpts::Parser parser = { {'x', "", "", ArgOpts::Arity::flag}, {'s', "", ""} };
+  parser.bindFlag('v', "verbose", &verbose);
+  parser.bind('n', "number", &number);
+
+  const char* argv[] = {"somecode", "-vn=5", "-xs=a"};
+  auto args = parser.parse(3, const_cast<char**>(argv));
+  EXPECT_TRUE( verbose );
+  EXPECT_EQ( number, 5 );
+  ASSERT_EQ( args.size(), 2 );
+  EXPECT_EQ( args[0].shortopt, 'x' );
+  EXPECT_EQ( args[0].arg.str(), "" );
+  EXPECT_EQ( args[1].arg.str(), "a" );
+
+  // A flag on its own still takes a value
+  const char* argv2[] = {"somecode", "-v=no", "-nv=7"};
+  parser.parse(3, const_cast<char**>(argv2));
+  EXPECT_TRUE( verbose );
+  EXPECT_EQ( number, 7 );
+  const char* argv3[] = {"somecode", "-v=no"};
+  parser.parse(2, const_cast<char**>(argv3));
+  EXPECT_FALSE( verbose );
+}
+
+TEST(ParserOptionsTests, BindVariables) {
+  int number = 0;
+  double tolerance = 0.0;
+  std::string name;
+  bool verbose = false, quiet = true;
+
+  ArgOpts::Parser parser;
+  parser.bind('n', "number", &number, "[N]");
+  parser.bind('t', "tolerance", &tolerance, "[TOL]");
+  parser.bind(0, "name", &name, "[NAME]");
+  parser.bindFlag('v', "verbose", &verbose);
+  parser.bindFlag('q', "quiet", &quiet);
+  parser.add('h', "help", "print help");
+
+  const char* argv[] = {"somecode", "-vn", "-3", "--tolerance=1e-3", "--name", "run",
+                        "--quiet=no", "-h", "--number=42"};
+  auto args = parser.parse(9, const_cast<char**>(argv));
+
+  // Only the unbound option is returned
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args[0].shortopt, 'h' );
+
+  EXPECT_EQ( number, 42 );
+  EXPECT_EQ( tolerance, 1e-3 );
+  EXPECT_EQ( name, "run" );
+  EXPECT_TRUE( verbose );
+  EXPECT_FALSE( quiet );
+}
+
+TEST(ParserOptionsTests, BindVariablesFail) {
+  int number = 5;
+  ArgOpts::Parser parser;
+  parser.bind('n', "number", &number, "[N] number of things");
+
+  const char* argv[] = {"somecode", "--number", "many"};
+  try {
+    parser.parse(3, const_cast<char**>(argv));
+    FAIL() << "Expected an exception";
+  } catch (const std::invalid_argument &e) {
+    EXPECT_NE( std::string(e.what()).find("-n, --number"), std::string::npos );
+  }
+  EXPECT_EQ( number, 5 );
+
+  // A parser with only bound options returns nothing, without allocating
+  const char* argv2[] = {"somecode", "-n7"};
+  auto args = parser.parse(2, const_cast<char**>(argv2));
+  EXPECT_TRUE( args.empty() );
+  EXPECT_EQ( args.capacity(), 0 );
+  EXPECT_EQ( number, 7 );
+}
+
+TEST(ParserOptionsTests, BindExpected) {
+  // Conversion errors are held in the variables, so parse doesn't throw
+  ArgOpts::Expected<int> number = 5, count = 1;
+  ArgOpts::Expected<double> scale = 2.0;
+  ArgOpts::Expected<bool> verbose = false, quiet = false;
+  ArgOpts::Parser parser;
+  parser.bind('n', "number", &number, "[N]");
+  parser.bind('c', "count", &count, "[N]");
+  parser.bind('s', "scale", &scale, "[X]");
+  parser.bindFlag('v', "verbose", &verbose);
+  parser.bindFlag('q', "quiet", &quiet);
+
+  const char* argv[] = {"somecode", "--number", "many", "-c", "99999999999", "-v",
+                        "--quiet=perhaps"};
+  EXPECT_NO_THROW( parser.parse(7, const_cast<char**>(argv)) );
+
+  EXPECT_EQ( number.status(), ArgOpts::ConversionStatus::invalid );
+  EXPECT_EQ( count.status(), ArgOpts::ConversionStatus::out_of_range );
+  EXPECT_EQ( scale.value(), 2.0 );
+  EXPECT_TRUE( verbose.value() );
+  EXPECT_EQ( quiet.status(), ArgOpts::ConversionStatus::invalid );
+
+  const char* argv2[] = {"somecode", "-n7", "--scale=0.5", "-q=no"};
+  parser.parse(4, const_cast<char**>(argv2));
+  EXPECT_EQ( number.value(), 7 );
+  EXPECT_EQ( scale.value(), 0.5 );
+  EXPECT_FALSE( quiet.value() );
+}
+
+TEST(ParserOptionsTests, VisitOptions) {
+  bool verbose = false;
+  ArgOpts::Parser parser = { {'n', "number", "[N] number of things"} };
+  parser.bindFlag('v', "verbose", &verbose);
+
+  const char* argv[] = {"somecode", "-v", "--number=3", "--other", "x", "-q"};
+  std::vector<std::string> seen;
+  int number = 0;
+  parser.parse(6, const_cast<char**>(argv), [&](const ArgOpts::Option &opt) {
+    seen.push_back(opt.usage() + ":" + opt.arg.str() + ":" + std::to_string(opt.index));
+    if (opt.shortopt == 'n') {
+      number = opt.arg;
+      // The value refers to argv
+      EXPECT_EQ( opt.arg.view().data(), argv[2] + 9 );
+    }
+  });
+
+  ASSERT_EQ( seen.size(), 3 );
+  EXPECT_EQ( seen[0], "-n, --number\t\t[N] number of things:3:2" );
+  EXPECT_EQ( seen[1], "--other:x:3" );
+  EXPECT_EQ( seen[2], "-q::5" );
+  EXPECT_EQ( number, 3 );
+  EXPECT_TRUE( verbose );
+
+  // Errors include the usage, also for unknown options
+  const char* argv2[] = {"somecode", "--other=x"};
+  std::string message;
+  parser.freeze().parse(2, const_cast<char**>(argv2), [&](const ArgOpts::Option &opt) {
+    try {
+      opt.arg.get<int>();
+    } catch (const std::invalid_argument &e) {
+      message = e.what();
+    }
+  });
+  EXPECT_NE( message.find("usage: --other"), std::string::npos );
+}
+
+///////////////////////////////////////////////////
+
+TEST(CompiledParserTests, MatchOptions) {
+  ArgOpts::Parser parser = { {'h', "help", "print help"},
+                             {'n', "number", "some number"} };
+  const ArgOpts::CompiledParser compiled = parser.freeze();
+
+  const char* argv[] = {"somecode", "--number", "42", "-hx"};
+  auto args = compiled.parse(4, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 3 );
+
+  auto it = args.begin();
+  EXPECT_EQ( it->shortopt, 'n' );
+  EXPECT_EQ( it->longopt, "number" );
+  EXPECT_EQ( it->index, 1 );
+  int val = it->arg;
+  EXPECT_EQ( val, 42 );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'h' );
+  EXPECT_EQ( it->longopt, "help" );
+  EXPECT_EQ( it->help, "print help" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'x' );
+  EXPECT_EQ( it->longopt, "" );
+}
+
+TEST(CompiledParserTests, UnknownLongOption) {
+  ArgOpts::CompiledParser compiled = { {'h', "help", "print help"} };
+
+  const char* argv[] = {"somecode", "--helpful"};
+  auto args = compiled.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args.front().shortopt, 0 );
+  EXPECT_EQ( args.front().longopt, "helpful" );
+  EXPECT_EQ( args.front().help, "" );
+}
+
+TEST(CompiledParserTests, UnchangedByParser) {
+  ArgOpts::Parser parser = { {'h', "help", "print help"} };
+  const ArgOpts::CompiledParser compiled = parser.freeze();
+  parser.add('v', "verbose", "print more");
+
+  const char* argv[] = {"somecode", "--verbose"};
+  auto args = compiled.parse(2, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 1 );
+  EXPECT_EQ( args.front().shortopt, 0 );
+  EXPECT_EQ( compiled.printOptions(), "-h, --help\t\tprint help\n" );
+}
+
+TEST(CompiledParserTests, ManyLongNames) {
+  std::vector<ArgOpts::OptionSpec> specs;
+  for (int n = 0; n < 100; n++) {
+    specs.push_back({0, "a-rather-long-option-name-" + std::to_string(n), ""});
+  }
+  specs.push_back({'d', "a-rather-long-option-name-7", "duplicate"});
+  ArgOpts::CompiledParser original(specs.begin(), specs.end());
+  const ArgOpts::CompiledParser compiled = original;
+  original = ArgOpts::CompiledParser({});
+
+  for (int n = 0; n < 100; n++) {
+    const std::string name = "a-rather-long-option-name-" + std::to_string(n);
+    const ArgOpts::OptionSpec *spec = compiled.findLong(name);
+    ASSERT_NE( spec, nullptr );
+    EXPECT_EQ( spec->longopt, name );
+  }
+  // The first option with a name takes precedence
+  EXPECT_EQ( compiled.findLong("a-rather-long-option-name-7")->shortopt, 0 );
+  EXPECT_EQ( compiled.findLong("a-rather-long-option-name-100"), nullptr );
+  EXPECT_EQ( compiled.findLong("a-rather-long-option-name-"), nullptr );
+  EXPECT_EQ( compiled.findLong(""), nullptr );
+}
+
+///////////////////////////////////////////////////
+
+namespace {
+  struct HelpOption {
+    static constexpr char shortopt = 'h';
+    static constexpr const char *longopt = "help";
+    static constexpr const char *help = "print help";
+  };
+
+  struct NumberOption {
+    static constexpr char shortopt = 'n';
+    static constexpr const char *longopt = "number";
+    static constexpr const char *help = "some number";
+  };
+
+  struct LongOnlyOption {
+    static constexpr char shortopt = 0;
+    static constexpr const char *longopt = "long-only";
+    static constexpr const char *help = "";
+  };
+
+  using TestSchema = ArgOpts::Schema<HelpOption, NumberOption, LongOnlyOption>;
+}
+
+TEST(SchemaTests, MatchOptions) {
+  const char* argv[] = {"somecode", "--number=42", "-xh", "--long-only", "--other"};
+  auto args = TestSchema::parse(5, const_cast<char**>(argv));
+
+  ASSERT_EQ( args.size(), 5 );
+
+  auto it = args.begin();
+  EXPECT_EQ( it->shortopt, 'n' );
+  EXPECT_EQ( it->longopt, "number" );
+  EXPECT_EQ( it->help, "some number" );
+  EXPECT_EQ( it->index, 1 );
+  int val = it->arg;
+  EXPECT_EQ( val, 42 );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'x' );
+  EXPECT_EQ( it->longopt, "" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 'h' );
+  EXPECT_EQ( it->longopt, "help" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 0 );
+  EXPECT_EQ( it->longopt, "long-only" );
+  ++it;
+  EXPECT_EQ( it->shortopt, 0 );
+  EXPECT_EQ( it->longopt, "other" );
+  EXPECT_EQ( it->help, "" );
+}
+
+TEST(SchemaTests, Lookup) {
+  EXPECT_EQ( TestSchema::findShort('n'), &TestSchema::options[1] );
+  EXPECT_EQ( TestSchema::findShort('q'), nullptr );
+  EXPECT_EQ( TestSchema::findShort(0), nullptr );
+  EXPECT_EQ( TestSchema::findLong("long-only"), &TestSchema::options[2] );
+  EXPECT_EQ( TestSchema::findLong("long"), nullptr );
+  EXPECT_EQ( TestSchema::findLong(""), nullptr );
+}
+
+namespace {
+  struct ShortOnlyOption {
+    static constexpr char shortopt = 'q';
+    static constexpr const char *longopt = "";
+    static constexpr const char *help = "";
+  };
+
+  struct OtherHelpOption {
+    static constexpr char shortopt = 'x';
+    static constexpr const char *longopt = "help";
+    static constexpr const char *help = "";
+  };
+}
+
+TEST(SchemaTests, LongTable) {
+  using Options = ArgOpts::Schema<ShortOnlyOption, HelpOption, OtherHelpOption,
+                                  NumberOption, LongOnlyOption>;
+  // Names which are in the same bucket are chained in order,
+  // so the first option with a name takes precedence
+  EXPECT_EQ( Options::findLong("help"), &Options::options[1] );
+  EXPECT_EQ( Options::findLong("number"), &Options::options[3] );
+  EXPECT_EQ( Options::findLong("long-only"), &Options::options[4] );
+  EXPECT_EQ( Options::findLong(""), nullptr );
+  EXPECT_EQ( Options::findLong("q"), nullptr );
+  EXPECT_EQ( Options::findShort('q'), &Options::options[0] );
+}
+
+namespace {
+  /// Option "--oN", with a short name for the first few
+  template <std::size_t N> struct NumberedOption {
+    static constexpr char shortopt = (N < 26) ? static_cast<char>('a' + N) : 0;
+    static constexpr char longopt[] = {'o', static_cast<char>('0' + N / 100 % 10),
+                                       static_cast<char>('0' + N / 10 % 10),
+                                       static_cast<char>('0' + N % 10), 0};
+    static constexpr const char *help = "";
+  };
+
+  template <std::size_t N> constexpr char NumberedOption<N>::longopt[];
+
+  template <typename Sequence> struct NumberedSchema;
+
+  template <std::size_t... N>
+  struct NumberedSchema<ArgOpts::detail::IndexSequence<N...>> {
+    using type = ArgOpts::Schema<NumberedOption<N>...>;
+  };
+}
+
+TEST(SchemaTests, ManyOptions) {
+  // More options than the compiler's template depth limit allows
+  // for tables built one option at a time
+  using Options = NumberedSchema<ArgOpts::detail::MakeIndexSequence<300>::type>::type;
+  EXPECT_EQ( sizeof(Options::options) / sizeof(Options::options[0]), 300 );
+  EXPECT_EQ( Options::findLong("o000"), &Options::options[0] );
+  EXPECT_EQ( Options::findLong("o299"), &Options::options[299] );
+  EXPECT_EQ( Options::findLong("o300"), nullptr );
+  EXPECT_EQ( Options::findShort('z'), &Options::options[25] );
+  EXPECT_EQ( Options::findShort('A'), nullptr );
+
+  const char* argv[] = {"somecode", "--o150=x", "-c"};
+  auto args = Options::parse(3, const_cast<char**>(argv));
+  ASSERT_EQ( args.size(), 2 );
+  EXPECT_EQ( args[0].index, 1 );
+  EXPECT_EQ( args[0].longopt, "o150" );
+  EXPECT_EQ( args[1].shortopt, 'c' );
+}
+
+TEST(SchemaTests, PrintOptions) {
+  EXPECT_EQ( TestSchema::printOptions(),
+             "-h, --help\t\tprint help\n"
+             "-n, --number\t\tsome number\n"
+             "--long-only\n" );
+}
+
+///////////////////////////////////////////////////
+
+TEST(ParseSessionTests, ParseTwice) {
+  ArgOpts::Parser parser = { {'n', "number", "some number"} };
+  ArgOpts::ParseSession session;
+
+  {
+    std::string value = "42";
+    char* argv[] = {const_cast<char*>("somecode"), const_cast<char*>("-n"), &value[0]};
+    auto &args = session.parse(3, argv, parser);
+    value = "99"; // Values are copied into the session
+
+    ASSERT_EQ( args.size(), 1 );
+    EXPECT_EQ( args[0].longopt, "number" );
+    int val = args[0].arg;
+    EXPECT_EQ( val, 42 );
+  }
+
+  const char* argv[] = {"somecode", "-ab=value", "--number", "x", "--other"};
+  const ArgOpts::CompiledParser compiled = parser.freeze();
+  auto &args = session.parse(5, const_cast<char**>(argv), compiled);
+
+  ASSERT_EQ( args.size(), 4 );
+  EXPECT_EQ( args[0].arg.view(), "value" );
+  // Grouped options share the value
+  EXPECT_EQ( args[0].arg.view().data(), args[1].arg.view().data() );
+  EXPECT_NE( args[0].arg.view().data(), argv[1] + 4 );
+  EXPECT_EQ( args[2].longopt, "number" );
+  EXPECT_ANY_THROW( args[2].arg.get<int>() );
+  // Unknown names are copied into the session
+  EXPECT_EQ( args[3].longopt, "other" );
+  EXPECT_NE( args[3].longopt.data(), argv[4] + 2 );
+
+  session.reset();
+  EXPECT_EQ( session.options_found().size(), 0 );
+}
+
+TEST(ParseSessionTests, LargeValues) {
+  const ArgOpts::Parser parser;
+  ArgOpts::ParseSession session;
+  std::vector<std::string> values;
+  std::vector<char*> argv = {const_cast<char*>("somecode")};
+  for (int n = 0; n < 100; n++) {
+    values.push_back("--opt" + std::to_string(n) + "=" + std::string(1000, 'a' + n % 26));
+  }
+  for (auto &value : values) {
+    argv.push_back(&value[0]);
+  }
+
+  for (int repeat = 0; repeat < 2; repeat++) {
+    auto &args = session.parse(static_cast<int>(argv.size()), argv.data(), parser);
+    ASSERT_EQ( args.size(), 100 );
+    for (int n = 0; n < 100; n++) {
+      EXPECT_EQ( args[n].arg.view(), std::string(1000, 'a' + n % 26) );
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+
+// Test the generator's functions, without its main()
+#define ARGOPTS_GEN_NO_MAIN
+#include "argopts_gen.cxx"
+
+namespace {
+  /// Builds a perfect hash of the names, checks that each is found in
+  /// its own slot, and returns the number of slots
+  std::size_t expectPerfect(const std::vector<std::string> &names) {
+    std::vector<std::uint32_t> seeds;
+    std::vector<int> slots;
+    perfectHash(names, seeds, slots);
+
+    EXPECT_EQ( seeds.size(), std::max<std::size_t>(names.size(), 1) );
+    EXPECT_GE( slots.size(), seeds.size() );
+    for (std::size_t n = 0; n < names.size(); n++) {
+      std::size_t slot = ArgOpts::detail::perfectHashSlot(
+          names[n].data(), names[n].size(), seeds.data(),
+          static_cast<std::uint32_t>(seeds.size()), static_cast<std::uint32_t>(slots.size()));
+      EXPECT_EQ( slots[slot], static_cast<int>(n) ) << names[n];
+    }
+    return slots.size();
+  }
+
+  std::vector<SchemaOption> readString(const std::string &text) {
+    std::istringstream in(text);
+    return readSchema(in, "test.opts");
+  }
+
+  /// The message from readSchema, or "" if it succeeds
+  std::string schemaError(const std::string &text) {
+    try {
+      readString(text);
+    } catch (const std::invalid_argument &e) {
+      return e.what();
+    }
+    return "";
+  }
+}
+
+TEST(GeneratorTests, PerfectHashPowerOfTwo) {
+  // The low bits of an unmixed FNV-1a hash only depend on the
+  // low bits of the seed, so these sizes used to fail
+  EXPECT_EQ( expectPerfect({"host", "port", "user", "pass"}), 4 );
+  EXPECT_EQ( expectPerfect({"foo-bar", "foo_bar"}), 2 );
+
+  for (std::size_t size = 1; size <= 1024; size *= 2) {
+    std::vector<std::string> names;
+    for (std::size_t n = 0; n < size; n++) {
+      names.push_back("option-" + std::to_string(n));
+    }
+    EXPECT_EQ( expectPerfect(names), size );
+  }
+}
+
+TEST(GeneratorTests, PerfectHashSmallSets) {
+  // Many sets of short random names, all of which should succeed quickly
+  std::uint32_t state = 12345;
+  auto next = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 16;
+  };
+  std::size_t minimal = 0, sets = 0;
+  for (std::size_t size : {3, 4, 5, 8, 16}) {
+    for (int repeat = 0; repeat < 200; repeat++) {
+      std::set<std::string> unique;
+      while (unique.size() < size) {
+        std::string name;
+        for (std::uint32_t length = 1 + next() % 8; length > 0; length--) {
+          name += static_cast<char>('a' + next() % 26);
+        }
+        unique.insert(name);
+      }
+      if (expectPerfect(std::vector<std::string>(unique.begin(), unique.end())) == size) {
+        minimal++;
+      }
+      sets++;
+    }
+  }
+  EXPECT_EQ( minimal, sets );
+}
+
+TEST(GeneratorTests, PerfectHashEmpty) {
+  std::vector<std::uint32_t> seeds;
+  std::vector<int> slots;
+  perfectHash({}, seeds, slots);
+  EXPECT_EQ( seeds.size(), 1 );
+  ASSERT_EQ( slots.size(), 1 );
+  EXPECT_EQ( slots[0], -1 );
+}
+
+TEST(GeneratorTests, ReadSchema) {
+  auto options = readString("# comment\n"
+                            "h help flag print help\n"
+                            "\n"
+                            "- 2d-size string [WxH] the size\n"
+                            "n - int\n");
+  ASSERT_EQ( options.size(), 3 );
+  EXPECT_EQ( options[0].help, "print help" );
+  EXPECT_EQ( options[1].type, "std::string" );
+  EXPECT_EQ( memberName(options[1]), "opt_2d_size" );
+  EXPECT_EQ( memberName(options[2]), "opt_n" );
+
+  EXPECT_NE( schemaError("h help\n").find("test.opts:1: expected"), std::string::npos );
+  EXPECT_NE( schemaError("- - flag none\n"), "" );
+}
+
+TEST(GeneratorTests, ReadSchemaMemberNames) {
+  EXPECT_EQ( schemaError("c class flag a keyword\n"),
+             "test.opts:1: member name 'class' for -c, --class is a C++ keyword" );
+  EXPECT_EQ( schemaError("a foo-bar flag\n"
+                         "b foo_bar flag\n"),
+             "test.opts:2: member name 'foo_bar' for -b, --foo_bar is already used by -a, --foo-bar" );
+  EXPECT_NE( schemaError("u unknown flag\n"), "" );
+  EXPECT_NE( schemaError("x - flag\n"
+                         "- opt_x flag\n"), "" );
+  // Each short name must select one option, as long names do
+  EXPECT_EQ( schemaError("a alpha int\n"
+                         "a beta int\n"),
+             "test.opts:2: short option -a for -a, --beta is already used by -a, --alpha" );
+  EXPECT_EQ( schemaError("x - flag\n"
+                         "x other flag\n").find("test.opts:2: short option -x"), 0u );
+  // A member would hide a type used by another member
+  EXPECT_NE( schemaError("d Distance flag\n"
+                         "- far Distance\n"), "" );
+}
+
+TEST(GeneratorTests, NamespaceName) {
+  EXPECT_EQ( namespaceName("dir/example4.opts"), "example4" );
+  EXPECT_EQ( namespaceName("my-opts.v2.opts"), "my_opts" );
+  // Keywords and leading digits are changed into identifiers
+  EXPECT_EQ( namespaceName("new.opts"), "new_opts" );
+  EXPECT_EQ( namespaceName("2opts.opts"), "opts_2opts" );
+  EXPECT_EQ( namespaceName(".opts"), "opts_" );
+
+  EXPECT_TRUE( isIdentifier("opts_2") );
+  EXPECT_FALSE( isIdentifier("2opts") );
+  EXPECT_FALSE( isIdentifier("new") );
+  EXPECT_FALSE( isIdentifier("a-b") );
+  EXPECT_FALSE( isIdentifier("") );
+}
+
+TEST(GeneratorTests, WriteHeaderDuplicateShort) {
+  std::vector<SchemaOption> options = {{'a', "alpha", "int", ""}, {'a', "beta", "int", ""}};
+  std::ostringstream out;
+  EXPECT_THROW( writeHeader(out, options, "test.opts", "test"), std::invalid_argument );
+}
+
+TEST(GeneratorTests, WriteHeader) {
+  auto options = readString("h help flag print help\n"
+                            "n number int some number\n");
+  std::ostringstream out;
+  writeHeader(out, options, "test.opts", "test");
+  const std::string header = out.str();
+
+  // Tables are static members of a template, so the header
+  // can be included in several source files
+  EXPECT_NE( header.find("static constexpr OptionInfo options[2]"), std::string::npos );
+  EXPECT_NE( header.find("constexpr OptionInfo BasicLookup<Unused>::options[2];"),
+             std::string::npos );
+  EXPECT_NE( header.find("using Lookup = BasicLookup<>;"), std::string::npos );
+  EXPECT_NE( header.find("int number = {};"), std::string::npos );
+  EXPECT_NE( header.find("case 1: result.number = opt.arg.get<int>(); break;"),
+             std::string::npos );
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}